@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# Boot each benchmark program in turn under Bochs and collect the
+# "bench <name> <iterations> <cycles>" lines they print into one
+# report, bench.out.  'make bench' runs this; pass -v to see the
+# build and the Bochs output.
+
+verbose=false
+
+if [ "x$1" = "x-v" ]
+then
+	verbose=true
+	out=/dev/stdout
+	err=/dev/stderr
+else
+	out=/dev/null
+	err=/dev/null
+fi
+
+timeout=300
+report=bench.out
+progs="benchsyscall benchyield benchipc benchpage benchfork benchrange benchtlb"
+
+# Run Bochs until the kernel drops into the monitor, as grade.sh does.
+runbochs () {
+	brkaddr=`grep 'readline$' obj/kern/kernel.sym | sed -e's/ .*$//g'`
+	(
+		echo vbreak 0x8:0x$brkaddr
+		sleep .5
+		echo c
+	) | (
+		ulimit -t $timeout
+		bochs -q 'display_library: nogui' \
+			'parport1: enabled=1, file="bochs.out"'
+	) >$out 2>$err
+}
+
+rm -f $report
+for prog in $progs
+do
+	rm -f obj/kern/init.o obj/kern/kernel obj/kern/bochs.img bochs.out
+	make "DEFS=-DTEST=_binary_obj_user_${prog}_start -DTESTSIZE=_binary_obj_user_${prog}_size" >$out
+	if [ $? -ne 0 ]
+	then
+		echo "$prog: make failed"
+		exit 1
+	fi
+	runbochs
+	if grep '^bench ' bochs.out >>$report 2>/dev/null
+	then
+		echo "$prog: OK"
+	else
+		echo "$prog: no results"
+	fi
+done
+
+echo
+awk '{ printf("%-24s %10s iterations %10s cycles\n", $2, $3, $4) }' $report
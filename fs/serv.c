@@ -30,6 +30,9 @@ struct OpenFile opentab[MAXOPEN] = {
 // Virtual address at which to receive page mappings containing client requests.
 #define REQVA		0x0ffff000
 
+// Write dirty blocks back after this many seconds without a request.
+#define FLUSH_SECS	3
+
 void
 serve_init(void)
 {
@@ -78,9 +81,29 @@ openfile_lookup(envid_t envid, uint32_t fileid, struct OpenFile **po)
 	return 0;
 }
 
+// The reply to the request being served.  serve() sends it to the
+// client as it waits for the next request.
+static struct Ipc_msg reply;
+static bool replying;
+
+// Reply r to the current request, with the page at srcva if it is
+// not 0.
+static void
+serve_reply(int32_t r, void *srcva, int perm)
+{
+	memset(&reply, 0, sizeof(reply));
+	reply.im_regs[0] = r;
+	if (srcva) {
+		reply.im_npages = 1;
+		reply.im_pages[0] = srcva;
+		reply.im_perm = perm;
+	}
+	replying = 1;
+}
+
 // Serve requests, sending responses back to envid.
-// To send a result back, ipc_send(envid, r, 0, 0).
-// To include a page, ipc_send(envid, r, srcva, perm).
+// To send a result back, serve_reply(r, 0, 0).
+// To include a page, serve_reply(r, srcva, perm).
 void
 serve_open(envid_t envid, struct Fsreq_open *rq)
 {
@@ -124,10 +147,10 @@ serve_open(envid_t envid, struct Fsreq_open *rq)
 
 	if (debug)
 		cprintf("sending success, page %08x\n", (uintptr_t) o->o_fd);
-	ipc_send(envid, 0, o->o_fd, PTE_P|PTE_U|PTE_W|PTE_SHARE);
+	serve_reply(0, o->o_fd, PTE_P|PTE_U|PTE_W|PTE_SHARE);
 	return;
 out:
-	ipc_send(envid, r, 0, 0);
+	serve_reply(r, 0, 0);
 }
 
 void
@@ -170,7 +193,7 @@ serve_set_size(envid_t envid, struct Fsreq_set_size *rq)
 	// Here's how it goes.
 
 	// First, use openfile_lookup to find the relevant open file.
-	// On failure, return the error code to the client with ipc_send.
+	// On failure, return the error code to the client with serve_reply.
 	if ((r = openfile_lookup(envid, rq->req_fileid, &o)) < 0)
 		goto out;
 
@@ -186,7 +209,7 @@ serve_set_size(envid_t envid, struct Fsreq_set_size *rq)
 	// Finally, return to the client!
 	// (We just return r since we know it's 0 at this point.)
 out:
-	ipc_send(envid, r, 0, 0);
+	serve_reply(r, 0, 0);
 }
 
 void
@@ -195,30 +218,43 @@ serve_map(envid_t envid, struct Fsreq_map *rq)
 	int r;
 	char *blk;
 	struct OpenFile *o;
-	int perm;
+	struct Ipc_msg m;
+	uint32_t bno, nblocks;
 
 	if (debug)
 		cprintf("serve_map %08x %08x %08x\n", envid, rq->req_fileid, rq->req_offset);
 
 	// Map the requested block in the client's address space
-	// by using ipc_send.
+	// by using serve_reply.
 	// Map read-only unless the file's open mode (o->o_mode) allows writes
 	// (see the O_ flags in inc/lib.h).
 	
 	// LAB 5: Your code here.
+    // Send up to req_npages blocks in one message, but none past the
+    // end of the file after the first.
     if ((r = openfile_lookup(envid, rq->req_fileid, &o)) < 0)
         goto out;
-    r = file_get_block(o->o_file, rq->req_offset / BLKSIZE, &blk);
-    if (r < 0)
+    memset(&m, 0, sizeof(m));
+    bno = rq->req_offset / BLKSIZE;
+    nblocks = ROUNDUP(o->o_file->f_size, BLKSIZE) / BLKSIZE;
+    while (m.im_npages < MAX(MIN(rq->req_npages, IPC_MAXPAGES), 1) &&
+           (m.im_npages == 0 || bno < nblocks)) {
+        if ((r = file_get_block(o->o_file, bno, &blk)) < 0)
+            break;
+        m.im_pages[m.im_npages++] = blk;
+        bno++;
+    }
+    if (m.im_npages == 0)
         goto out;
-    perm = PTE_U | PTE_SHARE | PTE_P;
+    m.im_perm = PTE_U | PTE_SHARE | PTE_P;
     if (o->o_mode)
-        perm |= PTE_W;
-    ipc_send(envid, r, blk, perm);
+        m.im_perm |= PTE_W;
+    reply = m;
+    replying = 1;
     return;
     
  out:
-	ipc_send(envid, r, 0, 0);
+	serve_reply(r, 0, 0);
 }
 
 void
@@ -236,7 +272,7 @@ serve_close(envid_t envid, struct Fsreq_close *rq)
 	r = 0;
 	
   out:
-	ipc_send(envid, r, 0, 0);
+	serve_reply(r, 0, 0);
 }
 
 void
@@ -254,7 +290,7 @@ serve_remove(envid_t envid, struct Fsreq_remove *rq)
 
 	// Delete the specified file
 	r = file_remove(path);
-	ipc_send(envid, r, 0, 0);
+	serve_reply(r, 0, 0);
 }
 
 void
@@ -267,7 +303,7 @@ serve_dirty(envid_t envid, struct Fsreq_dirty *rq)
 		cprintf("serve_dirty %08x %08x %08x\n", envid, rq->req_fileid, rq->req_offset);
 
 	// Find the file and dirty the file at the requested offset.
-	// Send the return value back using ipc_send.
+	// Send the return value back using serve_reply.
 	// LAB 5: Your code here.
     if ((r = openfile_lookup(envid, rq->req_fileid, &o)) < 0) {
         goto out;
@@ -277,25 +313,44 @@ serve_dirty(envid_t envid, struct Fsreq_dirty *rq)
     }
 
  out:
-    ipc_send(envid, r, 0, 0);
+    serve_reply(r, 0, 0);
 }
 
 void
 serve_sync(envid_t envid)
 {
 	fs_sync();
-	ipc_send(envid, 0, 0, 0);
+	serve_reply(0, 0, 0);
 }
 
 void
 serve(void)
 {
-	uint32_t req, whom;
-	int perm;
+	uint32_t req, whom = 0;
+	int r, perm, dirty = 0;
+	uint32_t flush_ticks = FLUSH_SECS * kinfo.ki_hz;
 	
+	// Requests come through FS_ENDPOINT, so that more workers could
+	// bind to it and share them.
+	if ((r = sys_ep_create(FS_ENDPOINT)) < 0 ||
+	    (r = sys_ep_bind(FS_ENDPOINT)) < 0)
+		panic("serving FS_ENDPOINT: %e", r);
+
+	// Each reply goes out with the wait for the next request, so a
+	// request costs the server a single system call.  Replies are
+	// only delivered to clients waiting in ipc_call_ep, as fsipc does.
+	// The request page stays mapped until the next one replaces it.
 	while (1) {
 		perm = 0;
-		req = ipc_recv((int32_t *) &whom, (void *) REQVA, &perm);
+		req = ipc_reply_recv(whom, replying ? &reply : 0,
+				     (int32_t *) &whom, (void *) REQVA, &perm,
+				     dirty ? flush_ticks : 0);
+		replying = 0;
+		if ((int32_t) req == -E_TIMEOUT) {
+			fs_sync();
+			dirty = 0;
+			continue;
+		}
 		if (debug) {
             cprintf("vpt=%p UVPT=%p\n", vpt, UVPT);
 			cprintf("fs req %d from %08x [page %08x: %s]\n",
@@ -309,8 +364,13 @@ serve(void)
 			continue; // just leave it hanging...
 		}
 
+		// Note every request that may leave modified blocks in the
+		// cache, so that they are written back when we go idle.
 		switch (req) {
 		case FSREQ_OPEN:
+			if (((struct Fsreq_open*)REQVA)->req_omode &
+			    (O_CREAT|O_TRUNC))
+				dirty = 1;
 			serve_open(whom, (struct Fsreq_open*)REQVA);
 			break;
 		case FSREQ_MAP:
@@ -318,24 +378,27 @@ serve(void)
 			break;
 		case FSREQ_SET_SIZE:
 			serve_set_size(whom, (struct Fsreq_set_size*)REQVA);
+			dirty = 1;
 			break;
 		case FSREQ_CLOSE:
 			serve_close(whom, (struct Fsreq_close*)REQVA);
 			break;
 		case FSREQ_DIRTY:
 			serve_dirty(whom, (struct Fsreq_dirty*)REQVA);
+			dirty = 1;
 			break;
 		case FSREQ_REMOVE:
 			serve_remove(whom, (struct Fsreq_remove*)REQVA);
+			dirty = 1;
 			break;
 		case FSREQ_SYNC:
 			serve_sync(whom);
+			dirty = 0;
 			break;
 		default:
 			cprintf("Invalid request code %d from %08x\n", whom, req);
 			break;
 		}
-		sys_page_unmap(0, (void*) REQVA);
 	}
 }
 
@@ -350,6 +413,9 @@ umain(void)
 	outw(0x8A00, 0x8A00);
 	cprintf("FS can do I/O\n");
 
+	// Every fsipc() blocks on us, so stay ahead of CPU-bound envs.
+	sys_env_set_priority(0, 0);
+
 	serve_init();
 	fs_init();
 	fs_test();
@@ -0,0 +1,30 @@
+// Public definitions for channels: single-producer, single-consumer
+// rings of 32-bit messages on a page shared by two environments.
+// See lib/chan.c for the implementation.
+
+#ifndef JOS_INC_CHAN_H
+#define JOS_INC_CHAN_H
+
+#include <inc/types.h>
+#include <inc/env.h>
+
+#define CHAN_NSLOT	512		// Ring size, a power of two
+#define CHAN_NOTIFY	0x80000000	// Notification bit used to wake waiters
+
+// A channel fills one page.  The producer only writes ch_tail and the
+// consumer only writes ch_head, and each sits on its own cache line.
+// Free-running indices: the ring is empty when they are equal and full
+// when they are CHAN_NSLOT apart.
+struct Chan {
+	volatile uint32_t ch_tail;	// Next slot to fill
+	volatile uint32_t ch_pwaiting;	// Producer is waiting for room
+	envid_t ch_producer;
+	uint8_t ch_pad0[64 - 12];
+	volatile uint32_t ch_head;	// Next slot to drain
+	volatile uint32_t ch_cwaiting;	// Consumer is waiting for a message
+	envid_t ch_consumer;
+	uint8_t ch_pad1[64 - 12];
+	volatile uint32_t ch_slot[CHAN_NSLOT];
+};
+
+#endif	// !JOS_INC_CHAN_H
@@ -7,6 +7,7 @@
 #include <inc/queue.h>
 #include <inc/trap.h>
 #include <inc/memlayout.h>
+#include <inc/syscall.h>
 
 typedef int32_t envid_t;
 
@@ -34,29 +35,120 @@ typedef int32_t envid_t;
 #define ENV_FREE		0
 #define ENV_RUNNABLE		1
 #define ENV_NOT_RUNNABLE	2
+#define ENV_DYING		3	// Destroyed while running on another CPU
+
+// Scheduling bands of the multilevel feedback queue; 0 is the highest.
+// Passing ENV_PRIO_UNPINNED to sys_env_set_priority hands the env back
+// to the scheduler's feedback rules.
+#define NENVPRIO		4
+#define ENV_PRIO_UNPINNED	(-1)
+
+// Environments given tickets with sys_env_set_tickets are scheduled by
+// stride, in proportion to their tickets; 0 tickets means MLFQ.
+#define ENV_MAXTICKETS		(1 << 20)
+
+// Environments given a reservation with sys_env_set_reservation get
+// 'budget' timer ticks in every 'period', earliest deadline first.
+#define ENV_MAXPERIOD		(1 << 20)
+
+// Extended IPC messages, see sys_ipc_sendv.
+#define IPC_NREGS		4	// Message registers per message
+#define IPC_MAXPAGES		8	// Pages per message
+#define IPC_DONATE		0x1	// Move the pages instead of sharing them
+
+// IPC endpoints, see sys_ep_create.
+#define NENDPOINT		16
+
+struct Endpoint;
+struct Envinfo;
+
+// Shared-memory segments, see sys_shm_create.
+#define NSHM			16
+#define SHM_MAXPAGES		256
+
+struct Ipc_msg {
+	uint32_t im_regs[IPC_NREGS];	// Message registers
+	unsigned im_npages;		// Number of pages to send
+	void *im_pages[IPC_MAXPAGES];	// Their addresses in the sender
+	int im_perm;			// Permissions to map them with
+	unsigned im_flags;		// IPC_DONATE or 0
+};
 
 struct Env {
 	struct Trapframe env_tf;	// Saved registers
 	LIST_ENTRY(Env) env_link;	// Free list link pointers
+	TAILQ_ENTRY(Env) env_sched_link;	// Run queue link pointers
 	envid_t env_id;			// Unique environment identifier
 	envid_t env_parent_id;		// env_id of this env's parent
 	unsigned env_status;		// Status of the environment
-	uint32_t env_runs;		// Number of times environment has run
+	uint32_t env_runs;		// Number of times environment was scheduled
     uint32_t env_syscalls;  // Number of syscalls environment has requested
+	uint32_t env_syscall_count[NSYSCALLS];	// The same, per syscall
+
+	// Scheduling
+	int env_cpu;			// CPU whose run queue we are on
+	int env_prio;			// Current MLFQ band
+	bool env_prio_pinned;		// Band fixed by sys_env_set_priority
+	uint32_t env_ticks;		// Timer ticks used in the current band
+	uint32_t env_boost_epoch;	// Last priority boost applied to us
+	uint32_t env_tickets;		// Stride shares, 0 if not in stride class
+	uint32_t env_stride;		// Pass increment per tick run
+	uint64_t env_pass;		// Stride virtual time
+	uint32_t env_budget;		// Ticks reserved per period, 0 if none
+	uint32_t env_period;		// Reservation period, in ticks
+	uint32_t env_budget_left;	// Ticks left in the current period
+	uint32_t env_deadline;		// Tick the current period ends at
+	uint32_t env_wakeup;		// Tick to wake at, 0 if none; see timer.c
+	LIST_ENTRY(Env) env_timer_link;	// Timer wheel slot link pointers
+
+	// CPU accounting, in TSC cycles
+	uint64_t env_user_cycles;	// Time spent in user mode
+	uint64_t env_kern_cycles;	// Time spent in the kernel for us
+	uint32_t env_traps;		// Traps and interrupts taken from user mode
+	uint32_t env_pgfaults;		// Page faults taken
 
 	// Address space
 	pde_t *env_pgdir;		// Kernel virtual address of page dir
 	physaddr_t env_cr3;		// Physical address of page dir
+	struct Envinfo *env_info;	// Kernel address of our UENVINFO page
 
 	// Exception handling
 	void *env_pgfault_upcall;	// page fault upcall entry point
 
 	// Lab 4 IPC
 	bool env_ipc_recving;		// env is blocked receiving
+	envid_t env_ipc_recv_from;	// only from this env, if not 0
 	void *env_ipc_dstva;		// va at which to map received page
+	unsigned env_ipc_maxpages;	// pages we have room for at dstva
 	uint32_t env_ipc_value;		// data value sent to us 
+	uint32_t env_ipc_regs[IPC_NREGS];	// message registers sent to us
 	envid_t env_ipc_from;		// envid of the sender	
 	int env_ipc_perm;		// perm of page mapping received
+	unsigned env_ipc_npages;	// pages received, from dstva on
+	envid_t env_ipc_handoff;	// receiver we woke, to run when we yield
+
+	// Futexes, see kern/futex.c
+	physaddr_t env_futex_pa;	// word we're blocked on, or 0
+	TAILQ_ENTRY(Env) env_futex_link;	// futex queue link pointers
+
+	// Notifications, see sys_notify
+	uint32_t env_notify_pending;	// bits sent to us, not yet taken
+	uint32_t env_notify_mask;	// bits we're blocked waiting for, or 0
+
+	// Blocking send, see sys_ipc_send
+	TAILQ_HEAD(, Env) env_ipc_senders;	// envs blocked sending to us
+	TAILQ_ENTRY(Env) env_ipc_link;	// env_ipc_senders link pointers
+	envid_t env_ipc_sendto;		// env we're blocked sending to, or 0
+	struct Endpoint *env_ipc_send_ep;	// or endpoint we're calling
+	bool env_ipc_calling;		// and then receiving its reply
+	TAILQ_HEAD(, Env) env_ipc_callers;	// envs waiting for our reply
+	TAILQ_ENTRY(Env) env_ipc_reply_link;	// env_ipc_callers link pointers
+	struct Ipc_msg env_ipc_send_msg;	// what we're sending
+
+	// Endpoints, see kern/endpoint.c
+	struct Endpoint *env_ep;	// endpoint we serve, or NULL
+	bool env_ep_waiting;		// on env_ep's ep_receivers
+	TAILQ_ENTRY(Env) env_ep_link;	// ep_receivers link pointers
 };
 
 #endif // !JOS_INC_ENV_H
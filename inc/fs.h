@@ -65,6 +65,8 @@ struct Super {
 
 // Definitions for requests from clients to file system
 
+#define FS_ENDPOINT	0	// IPC endpoint the file server serves
+
 #define FSREQ_OPEN     1
 #define FSREQ_MAP      2
 #define FSREQ_SET_SIZE 3
@@ -81,6 +83,7 @@ struct Fsreq_open {
 struct Fsreq_map {
 	int req_fileid;
 	off_t req_offset;
+	int req_npages;		// Blocks wanted from req_offset on, 0 means 1
 };
 
 struct Fsreq_set_size {
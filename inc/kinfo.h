@@ -0,0 +1,26 @@
+#ifndef JOS_INC_KINFO_H
+#define JOS_INC_KINFO_H
+
+#include <inc/types.h>
+#include <inc/env.h>
+
+// Information the kernel keeps up to date in pages mapped read-only
+// into every environment, so that reading it takes no system call.
+
+// Global, at UKINFO.  The timer only interrupts when the kernel has
+// something to do, so ki_ticks can lag; the exact tick count is
+// (rdtsc - ki_tsc_boot) / (ki_tsc_freq / ki_hz), see time_ticks().
+struct Kinfo {
+	uint32_t ki_ticks;		// Clock ticks at the last timer interrupt
+	uint32_t ki_hz;			// Clock ticks per second
+	uint64_t ki_tsc_freq;		// TSC cycles per second
+	uint64_t ki_tsc_boot;		// TSC at clock tick 0
+	uint32_t ki_free_pages;		// Physical pages free
+};
+
+// Per environment, at UENVINFO.
+struct Envinfo {
+	envid_t ei_envid;		// The environment's own id
+};
+
+#endif /* !JOS_INC_KINFO_H */
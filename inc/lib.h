@@ -16,10 +16,13 @@
 #include <inc/env.h>
 #include <inc/memlayout.h>
 #include <inc/syscall.h>
+#include <inc/kinfo.h>
 #include <inc/trap.h>
 #include <inc/fs.h>
 #include <inc/fd.h>
 #include <inc/args.h>
+#include <inc/chan.h>
+#include <inc/sync.h>
 
 #define USED(x)		(void)(x)
 
@@ -28,6 +31,9 @@ extern char *binaryname;
 extern volatile struct Env *env;
 extern volatile struct Env envs[NENV];
 extern volatile struct Page pages[];
+extern volatile struct Kinfo kinfo;
+extern volatile struct Envinfo envinfo;
+extern volatile struct Syscall_stats syscall_stats;
 void	exit(void);
 
 // pgfault.c
@@ -42,8 +48,12 @@ int	sys_cgetc(void);
 envid_t	sys_getenvid(void);
 int	sys_env_destroy(envid_t);
 void	sys_yield(void);
+int	sys_yield_to(envid_t env);
 static envid_t sys_exofork(void);
 int	sys_env_set_status(envid_t env, int status);
+int	sys_env_set_priority(envid_t env, int prio);
+int	sys_env_set_tickets(envid_t env, uint32_t tickets);
+int	sys_env_set_reservation(envid_t env, uint32_t budget, uint32_t period);
 int	sys_env_set_trapframe(envid_t env, struct Trapframe *tf);
 int	sys_env_set_pgfault_upcall(envid_t env, void *upcall);
 int	sys_page_alloc(envid_t env, void *pg, int perm);
@@ -51,7 +61,33 @@ int	sys_page_map(envid_t src_env, void *src_pg,
 		     envid_t dst_env, void *dst_pg, int perm);
 int	sys_page_unmap(envid_t env, void *pg);
 int	sys_ipc_try_send(envid_t to_env, uint32_t value, void *pg, int perm);
+int	sys_ipc_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int	sys_ipc_recv(void *rcv_pg);
+int	sys_ipc_recv_timeout(void *rcv_pg, unsigned ticks);
+int	sys_ipc_sendv(envid_t to_env, const struct Ipc_msg *msg);
+int	sys_ipc_recvv(void *rcv_pg, unsigned npages, unsigned ticks);
+int	sys_ipc_call(envid_t to_env, const struct Ipc_msg *msg, void *rcv_pg,
+		     unsigned npages);
+int	sys_ipc_reply_recv(envid_t to_env, const struct Ipc_msg *reply,
+			   void *rcv_pg, unsigned npages, unsigned ticks);
+int	sys_sleep(unsigned ticks);
+int	sys_notify(envid_t env, uint32_t bits);
+uint32_t sys_wait_notify(uint32_t mask);
+int	sys_ep_create(int ep);
+int	sys_ep_bind(int ep);
+int	sys_ep_call(int ep, const struct Ipc_msg *msg, void *rcv_pg,
+		    unsigned npages);
+int	sys_futex_wait(volatile uint32_t *va, uint32_t expected);
+int	sys_futex_wake(volatile uint32_t *va, int n);
+int	sys_shm_create(uint32_t key, unsigned npages);
+int	sys_shm_attach(uint32_t key, void *va, int perm);
+int	sys_shm_detach(void *va);
+int	sys_shm_destroy(uint32_t key);
+int	sys_batch(struct Sysbatch *ops, unsigned n);
+int	sys_page_alloc_range(envid_t env, void *pg, size_t len, int perm);
+int	sys_page_map_range(envid_t src_env, void *src_pg,
+			   envid_t dst_env, void *dst_pg, size_t len, int perm);
+int	sys_page_unmap_range(envid_t env, void *pg, size_t len);
 int sys_debug_va_mapping(uint32_t va);
 
 // This must be inlined.  Exercise for reader: why?
@@ -60,17 +96,67 @@ static __inline envid_t
 sys_exofork(void)
 {
 	envid_t ret;
-	__asm __volatile("int %2"
+	// The sysenter sequence from lib/syscall.c, with no arguments.
+	// The child starts at 1: with %eax 0.
+	__asm __volatile("pushl $0\n\t"
+		"pushl %%ebp\n\t"
+		"movl %%esp, %%ebp\n\t"
+		"movl $1f, %%esi\n\t"
+		"sysenter\n"
+		"1:\tpopl %%ebp\n\t"
+		"addl $4, %%esp\n\t"
 		: "=a" (ret)
-		: "a" (SYS_exofork),
-		  "i" (T_SYSCALL)
+		: "a" (SYS_exofork)
+		: "ecx", "edx", "esi", "cc", "memory"
 	);
 	return ret;
 }
 
+// time.c
+uint32_t	time_ticks(void);
+uint64_t	time_msec(void);
+
 // ipc.c
 void	ipc_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int32_t ipc_recv(envid_t *from_env_store, void *pg, int *perm_store);
+int32_t ipc_recv_timeout(envid_t *from_env_store, void *pg, int *perm_store,
+			 unsigned ticks);
+int	ipc_sendv(envid_t to_env, const struct Ipc_msg *msg);
+int	ipc_recvv(envid_t *from_env_store, void *pg, unsigned npages,
+		  uint32_t *regs_store);
+int32_t	ipc_call(envid_t to_env, const struct Ipc_msg *msg, void *pg,
+		 unsigned npages);
+int32_t	ipc_call_ep(int ep, const struct Ipc_msg *msg, void *pg,
+		    unsigned npages);
+int32_t	ipc_reply_recv(envid_t to_env, const struct Ipc_msg *reply,
+		       envid_t *from_env_store, void *pg, int *perm_store,
+		       unsigned ticks);
+
+// chan.c
+int	chan_create(struct Chan *c, envid_t producer, envid_t consumer);
+void	chan_send(struct Chan *c, uint32_t v);
+uint32_t chan_recv(struct Chan *c);
+
+// sync.c
+void	mutex_init(struct Mutex *m);
+void	mutex_lock(struct Mutex *m);
+void	mutex_unlock(struct Mutex *m);
+void	cond_init(struct Cond *c);
+void	cond_wait(struct Cond *c, struct Mutex *m);
+void	cond_signal(struct Cond *c);
+void	cond_broadcast(struct Cond *c);
+void	sem_init(struct Sem *s, uint32_t count);
+void	sem_wait(struct Sem *s);
+void	sem_post(struct Sem *s);
+
+// batch.c
+#define BATCHVA		(PFTEMP - PGSIZE)	// Page holding the queue
+int	batch_page_alloc(envid_t env, void *pg, int perm);
+int	batch_page_map(envid_t src_env, void *src_pg,
+		       envid_t dst_env, void *dst_pg, int perm);
+int	batch_page_unmap(envid_t env, void *pg);
+int	batch_env_set_status(envid_t env, int status);
+int	batch_flush(void);
 
 // fork.c
 #define	PTE_SHARE	0x400
@@ -98,6 +184,7 @@ int	sync(void);
 // fsipc.c
 int	fsipc_open(const char *path, int omode, struct Fd *fd);
 int	fsipc_map(int fileid, off_t offset, void *dst_va);
+int	fsipc_mapv(int fileid, off_t offset, void *dst_va, int npages);
 int	fsipc_set_size(int fileid, off_t size);
 int	fsipc_close(int fileid);
 int	fsipc_dirty(int fileid, off_t offset);
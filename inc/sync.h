@@ -0,0 +1,26 @@
+// Public definitions for the futex-based synchronization library:
+// mutexes, condition variables and counting semaphores that work
+// between environments sharing the page they live on, whatever address
+// each maps it at.  See lib/sync.c for the implementation.
+
+#ifndef JOS_INC_SYNC_H
+#define JOS_INC_SYNC_H
+
+#include <inc/types.h>
+
+// 0: unlocked, 1: locked, 2: locked and maybe contended.
+struct Mutex {
+	volatile uint32_t m_state;
+};
+
+struct Cond {
+	volatile uint32_t c_seq;	// Bumped by every signal
+	volatile uint32_t c_waiters;	// Envs in cond_wait
+};
+
+struct Sem {
+	volatile uint32_t s_count;
+	volatile uint32_t s_waiters;	// Envs in sem_wait
+};
+
+#endif	// !JOS_INC_SYNC_H
@@ -1,6 +1,8 @@
 #ifndef JOS_INC_SYSCALL_H
 #define JOS_INC_SYSCALL_H
 
+#include <inc/types.h>
+
 /* system call numbers */
 enum
 {
@@ -19,7 +21,56 @@ enum
 	SYS_ipc_try_send,
 	SYS_ipc_recv,
     SYS_debug_va_mapping,
+	SYS_env_set_priority,
+	SYS_env_set_tickets,
+	SYS_yield_to,
+	SYS_sleep,
+	SYS_ipc_send,
+	SYS_env_set_reservation,
+	SYS_ipc_sendv,
+	SYS_ipc_recvv,
+	SYS_ipc_call,
+	SYS_ipc_reply_recv,
+	SYS_notify,
+	SYS_wait_notify,
+	SYS_ep_create,
+	SYS_ep_bind,
+	SYS_ep_call,
+	SYS_futex_wait,
+	SYS_futex_wake,
+	SYS_shm_create,
+	SYS_shm_attach,
+	SYS_shm_detach,
+	SYS_shm_destroy,
+	SYS_batch,
+	SYS_page_alloc_range,
+	SYS_page_map_range,
+	SYS_page_unmap_range,
 	NSYSCALLS
 };
 
+// One system call of a sys_batch request: sb_num is SYS_page_alloc,
+// SYS_page_map, SYS_page_unmap or SYS_env_set_status, and sb_args are
+// its arguments in order.
+#define SYSBATCH_MAX	128
+
+struct Sysbatch {
+	uint32_t sb_num;
+	uint32_t sb_args[5];
+	int32_t sb_ret;		// Its result, filled in by the kernel
+};
+
+// Per-syscall statistics kept by the kernel, mapped read-only at
+// USYSSTATS.  Histogram bucket i counts calls that took [2^i, 2^(i+1))
+// TSC cycles, bucket 0 also those that took none.  A call that blocks
+// and switches to another env never returns through syscall(), so it
+// is counted in ss_count but not timed.
+#define NSYSHIST	32
+
+struct Syscall_stats {
+	uint64_t ss_count[NSYSCALLS];		// Calls made
+	uint64_t ss_cycles[NSYSCALLS];		// Cycles spent in timed calls
+	uint32_t ss_hist[NSYSCALLS][NSYSHIST];	// Latency histogram
+};
+
 #endif /* !JOS_INC_SYSCALL_H */
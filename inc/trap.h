@@ -34,6 +34,8 @@
 #define IRQ_KBD          1
 #define IRQ_SPURIOUS     7
 #define IRQ_IDE         14
+#define IRQ_RESCHED     17	// IPI: run queue has work, see sched_enqueue()
+#define IRQ_TLB         18	// IPI: flush the TLB, see tlb_shootdown()
 #define IRQ_ERROR       19
 
 #ifndef __ASSEMBLER__
@@ -85,8 +87,6 @@ struct UTrapframe {
 
 typedef void (*traphandler_t)(struct Trapframe *);
 
-extern int32_t do_sysenter(struct Trapframe *tf);
-
 #define MAGIC_BLANK 0x12345678
 
 #endif /* !__ASSEMBLER__ */
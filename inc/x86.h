@@ -34,6 +34,7 @@ static __inline uint32_t read_ebp(void) __attribute__((always_inline));
 static __inline uint32_t read_esp(void) __attribute__((always_inline));
 static __inline void cpuid(uint32_t info, uint32_t *eaxp, uint32_t *ebxp, uint32_t *ecxp, uint32_t *edxp);
 static __inline uint64_t read_tsc(void) __attribute__((always_inline));
+static __inline uint32_t xchg(volatile uint32_t *addr, uint32_t newval) __attribute__((always_inline));
 
 static __inline void
 breakpoint(void)
@@ -274,4 +275,42 @@ read_tsc(void)
         return tsc;
 }
 
+static __inline uint32_t
+xchg(volatile uint32_t *addr, uint32_t newval)
+{
+	uint32_t result;
+
+	// The + in "+m" denotes a read-modify-write operand.
+	__asm __volatile("lock; xchgl %0, %1" :
+			 "+m" (*addr), "=a" (result) :
+			 "1" (newval) :
+			 "cc");
+	return result;
+}
+
+// If *addr holds oldval, store newval there.  Either way, return what
+// *addr held.
+static __inline uint32_t
+cmpxchg(volatile uint32_t *addr, uint32_t oldval, uint32_t newval)
+{
+	uint32_t result;
+
+	__asm __volatile("lock; cmpxchgl %2, %1" :
+			 "=a" (result), "+m" (*addr) :
+			 "r" (newval), "0" (oldval) :
+			 "cc");
+	return result;
+}
+
+// Add incr to *addr and return what *addr held before.
+static __inline uint32_t
+xadd(volatile uint32_t *addr, uint32_t incr)
+{
+	__asm __volatile("lock; xaddl %0, %1" :
+			 "+r" (incr), "+m" (*addr) :
+			 :
+			 "cc");
+	return incr;
+}
+
 #endif /* !JOS_INC_X86_H */
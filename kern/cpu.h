@@ -0,0 +1,60 @@
+#ifndef JOS_KERN_CPU_H
+#define JOS_KERN_CPU_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+#include <inc/memlayout.h>
+#include <inc/mmu.h>
+#include <inc/env.h>
+
+struct Sysframe;
+
+// Maximum number of CPUs
+#define NCPU  8
+
+// Values of status in struct Cpu
+enum {
+	CPU_UNUSED = 0,
+	CPU_STARTED,
+	CPU_HALTED,
+};
+
+// Per-CPU state
+struct Cpu {
+	uint8_t cpu_id;                 // Local APIC ID; index into cpus[] below
+	volatile unsigned cpu_status;   // The status of the CPU
+	struct Env *cpu_env;            // The currently-running environment.
+	struct Taskstate cpu_ts;        // Used by x86 to find stack for interrupt
+	uint64_t cpu_acct_stamp;        // TSC at the last kernel entry or exit
+	struct Sysframe *cpu_sysframe;  // State of a sysenter syscall not yet in env_tf
+	volatile uint32_t cpu_tlb_flush; // Set by tlb_shootdown() until we flush
+};
+
+// Initialized in mpconfig.c
+extern struct Cpu cpus[NCPU];
+extern int ncpu;                    // Total number of CPUs in the system
+extern struct Cpu *bootcpu;         // The boot-strap processor (BSP)
+extern physaddr_t lapicaddr;        // Physical MMIO address of the local APIC
+extern volatile uint32_t *lapic;    // Its mapping, or NULL if there is none
+
+// Per-CPU kernel stacks; CPU 0 uses bootstack
+extern unsigned char percpu_kstacks[NCPU][KSTKSIZE];
+
+// Top of CPU i's kernel stack, see inc/memlayout.h
+#define KSTACKTOP_CPU(i)	(KSTACKTOP - (i) * (KSTKSIZE + KSTKGAP))
+
+int cpunum(void);
+#define thiscpu (&cpus[cpunum()])
+
+void mp_init(void);
+void lapic_init(void);
+void lapic_startap(uint8_t apicid, uint32_t addr);
+void lapic_eoi(void);
+void lapic_ipi(int cpu, int vector);
+void lapic_timer_periodic(void);
+unsigned lapic_timer_oneshot(unsigned ticks);
+void lapic_timer_stop(void);
+
+#endif
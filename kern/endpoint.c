@@ -0,0 +1,106 @@
+// IPC endpoints.
+//
+// An endpoint is a request queue that any number of worker envs can
+// serve.  An env creates endpoint number n with sys_ep_create; it and
+// its children may then bind to it with sys_ep_bind.  Whenever a bound
+// env receives, it takes messages sent to the endpoint with
+// sys_ep_call as well as those sent to it directly, and while it is
+// blocked receiving it waits on ep_receivers.  A call goes to the
+// worker that has been idle longest, or queues on ep_senders until one
+// receives, and the caller then waits for that worker's reply.
+
+#include <inc/error.h>
+
+#include <kern/env.h>
+#include <kern/sched.h>
+#include <kern/endpoint.h>
+
+struct Endpoint endpoints[NENDPOINT];
+
+void
+endpoint_init(void)
+{
+    int i;
+
+    for (i = 0; i < NENDPOINT; i++) {
+        TAILQ_INIT(&endpoints[i].ep_receivers);
+        TAILQ_INIT(&endpoints[i].ep_senders);
+    }
+}
+
+// Find endpoint number 'ep', which must have been created by an env
+// that still exists, for binding to it.
+// Returns 0 on success, -E_INVAL if ep is out of range, -E_BAD_ENV if
+// nobody has created it.
+int
+endpoint_lookup(int ep, struct Endpoint **ep_store)
+{
+    if (ep < 0 || ep >= NENDPOINT)
+        return -E_INVAL;
+    if (!endpoints[ep].ep_owner)
+        return -E_BAD_ENV;
+    *ep_store = &endpoints[ep];
+    return 0;
+}
+
+// e, which is bound, blocks receiving: make it available to callers.
+void
+endpoint_wait(struct Env *e)
+{
+    TAILQ_INSERT_TAIL(&e->env_ep->ep_receivers, e, env_ep_link);
+    e->env_ep_waiting = 1;
+}
+
+// e, which is bound, stops waiting for callers, if it was.
+static void
+endpoint_unwait(struct Env *e)
+{
+    if (!e->env_ep_waiting)
+        return;
+    TAILQ_REMOVE(&e->env_ep->ep_receivers, e, env_ep_link);
+    e->env_ep_waiting = 0;
+}
+
+// e stops waiting on an endpoint, if it was: as a worker for callers
+// of its own, or as a caller for a worker.
+void
+endpoint_cancel(struct Env *e)
+{
+    endpoint_unwait(e);
+    if (e->env_ipc_send_ep) {
+        TAILQ_REMOVE(&e->env_ipc_send_ep->ep_senders, e, env_ipc_link);
+        e->env_ipc_send_ep = NULL;
+        e->env_ipc_calling = 0;
+    }
+}
+
+// e is being freed.  Take it off the endpoint it was calling, and
+// close the endpoints it created: unbind their workers and fail the
+// calls queued on them.
+void
+endpoint_env_free(struct Env *e)
+{
+    struct Env *s;
+    int i;
+
+    endpoint_cancel(e);
+    e->env_ep = NULL;
+
+    for (i = 0; i < NENDPOINT; i++) {
+        if (endpoints[i].ep_owner != e->env_id)
+            continue;
+        endpoints[i].ep_owner = 0;
+        for (s = envs; s < envs + NENV; s++)
+            if (s->env_ep == &endpoints[i]) {
+                endpoint_unwait(s);
+                s->env_ep = NULL;
+            }
+        while ((s = TAILQ_FIRST(&endpoints[i].ep_senders)) != NULL) {
+            TAILQ_REMOVE(&endpoints[i].ep_senders, s, env_ipc_link);
+            s->env_ipc_send_ep = NULL;
+            s->env_ipc_calling = 0;
+            s->env_tf.tf_regs.reg_eax = -E_BAD_ENV;
+            sched_set_status(s, ENV_RUNNABLE);
+        }
+    }
+}
@@ -0,0 +1,25 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_ENDPOINT_H
+#define JOS_KERN_ENDPOINT_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/env.h>
+
+struct Endpoint {
+	envid_t ep_owner;		// Env that created us, 0 if free
+	TAILQ_HEAD(, Env) ep_receivers;	// Bound envs blocked receiving
+	TAILQ_HEAD(, Env) ep_senders;	// Envs blocked calling us
+};
+
+extern struct Endpoint endpoints[NENDPOINT];
+
+void endpoint_init(void);
+int  endpoint_lookup(int ep, struct Endpoint **ep_store);
+void endpoint_wait(struct Env *e);
+void endpoint_cancel(struct Env *e);
+void endpoint_env_free(struct Env *e);
+
+#endif	// !JOS_KERN_ENDPOINT_H
@@ -12,10 +12,13 @@
 #include <kern/trap.h>
 #include <kern/monitor.h>
 #include <kern/sched.h>
+#include <kern/syscall.h>
+#include <kern/endpoint.h>
+#include <kern/shm.h>
+#include <kern/spinlock.h>
 #include <kern/kdebug.h>
 
 struct Env *envs = NULL;		// All environments
-struct Env *curenv = NULL;	        // The current env
 static struct Env_list env_free_list;	// Free list
 
 #define ENVGENSHIFT	12		// >= LOGNENV
@@ -77,6 +80,7 @@ env_init(void)
 
     for (i = NENV - 1; i >= 0; i--) {
         envs[i].env_id = 0;
+        envs[i].env_status = ENV_FREE;
         LIST_INSERT_HEAD(&env_free_list, &envs[i], env_link);
     }
 }
@@ -95,11 +99,16 @@ static int
 env_setup_vm(struct Env *e)
 {
 	int i, r;
-	struct Page *p = NULL;
+	struct Page *p = NULL, *pt, *info;
 
-	// Allocate a page for the page directory
+	// Allocate a page for the page directory, and for the page
+	// table and page behind UINFO's per-env part
 	if ((r = page_alloc(&p)) < 0)
 		return r;
+	if ((r = page_alloc(&pt)) < 0)
+		goto fail_pt;
+	if ((r = page_alloc(&info)) < 0)
+		goto fail_info;
 
 	// Now, set e->env_pgdir and e->env_cr3,
 	// and initialize the page directory.
@@ -111,7 +120,6 @@ env_setup_vm(struct Env *e)
 	//	Can you use boot_pgdir as a template?  Hint: Yes.
 	//	(Make sure you got the permissions right in Lab 2.)
 	//    - The initial VA below UTOP is empty.
-	//    - You do not need to make any more calls to page_alloc.
 	//    - Note: pp_ref is not maintained for most physical pages
 	//	mapped above UTOP -- but you do need to increment
 	//	env_pgdir's pp_ref!
@@ -131,7 +139,23 @@ env_setup_vm(struct Env *e)
 	e->env_pgdir[PDX(VPT)]  = e->env_cr3 | PTE_P | PTE_W;
 	e->env_pgdir[PDX(UVPT)] = e->env_cr3 | PTE_P | PTE_U;
 
+    // UINFO maps the same global pages as in boot_pgdir, plus the
+    // env's own Envinfo at UENVINFO.
+    pt->pp_ref++;
+    info->pp_ref++;
+    memmove(page2kva(pt), KADDR(PTE_ADDR(boot_pgdir[PDX(UINFO)])), PGSIZE);
+    ((pte_t *) page2kva(pt))[PTX(UENVINFO)] = page2pa(info) | PTE_P | PTE_U;
+    e->env_pgdir[PDX(UINFO)] = page2pa(pt) | PTE_P | PTE_U;
+    e->env_info = page2kva(info);
+    memset(e->env_info, 0, PGSIZE);
+
 	return 0;
+
+fail_info:
+    page_free(pt);
+fail_pt:
+    page_free(p);
+    return r;
 }
 
 //
@@ -161,12 +185,18 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 	if (generation <= 0)	// Don't create a negative env_id.
 		generation = 1 << ENVGENSHIFT;
 	e->env_id = generation | (e - envs);
+	e->env_info->ei_envid = e->env_id;
 	
 	// Set the basic status variables.
 	e->env_parent_id = parent_id;
-	e->env_status = ENV_RUNNABLE;
 	e->env_runs = 0;
+	e->env_user_cycles = 0;
+	e->env_kern_cycles = 0;
+	e->env_traps = 0;
+	e->env_pgfaults = 0;
     e->env_syscalls = 0;
+    memset(e->env_syscall_count, 0, sizeof(e->env_syscall_count));
+    sched_env_init(e);
 
 	// Clear out all the saved register state,
 	// to prevent the register values
@@ -195,15 +225,29 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 
 	// Also clear the IPC receiving flag.
 	e->env_ipc_recving = 0;
-
-	// If this is the file server (e == &envs[1]) give it I/O privileges.
+	e->env_ipc_recv_from = 0;
+	e->env_ipc_handoff = 0;
+	e->env_wakeup = 0;
+	TAILQ_INIT(&e->env_ipc_senders);
+	e->env_ipc_sendto = 0;
+	e->env_ipc_calling = 0;
+	TAILQ_INIT(&e->env_ipc_callers);
+	e->env_ipc_send_ep = NULL;
+	e->env_ep = NULL;
+	e->env_ep_waiting = 0;
+	e->env_futex_pa = 0;
+	e->env_notify_pending = 0;
+	e->env_notify_mask = 0;
+
+	// If this is the file server (e == &envs[0]) give it I/O privileges.
 	// LAB 5: Your code here.
-    if (e == &envs[1]) {
+    if (e == &envs[0]) {
         e->env_tf.tf_eflags |= FL_IOPL_MASK;
     }
 
 	// commit the allocation
 	LIST_REMOVE(e, env_link);
+	sched_set_status(e, ENV_RUNNABLE);
 	*newenv_store = e;
 
 	// cprintf("[%08x] new env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
@@ -348,6 +392,35 @@ env_create(uint8_t *binary, size_t size)
     load_icode(env, binary, size);
 }
 
+//
+// e stops the IPC it is blocked in, if any: it leaves the queue of the
+// env or endpoint it is sending to, or of the env whose reply it waits
+// for, and no longer receives.
+// Returns 1 if e was blocked in IPC, 0 if not.
+//
+bool
+env_ipc_cancel(struct Env *e)
+{
+	bool blocked = e->env_ipc_recving || e->env_ipc_sendto ||
+		       e->env_ipc_send_ep;
+	struct Env *s;
+
+	if (e->env_ipc_recv_from) {
+		s = &envs[ENVX(e->env_ipc_recv_from)];
+		TAILQ_REMOVE(&s->env_ipc_callers, e, env_ipc_reply_link);
+		e->env_ipc_recv_from = 0;
+	}
+	if (e->env_ipc_sendto) {
+		s = &envs[ENVX(e->env_ipc_sendto)];
+		TAILQ_REMOVE(&s->env_ipc_senders, e, env_ipc_link);
+		e->env_ipc_sendto = 0;
+		e->env_ipc_calling = 0;
+	}
+	endpoint_cancel(e);
+	e->env_ipc_recving = 0;
+	return blocked;
+}
+
 //
 // Frees env e and all memory it uses.
 // 
@@ -357,7 +430,28 @@ env_free(struct Env *e)
 	pte_t *pt;
 	uint32_t pdeno, pteno;
 	physaddr_t pa;
+	struct Env *s;
 	
+	// Fail the sends blocked on us, and give up our own.
+	while ((s = TAILQ_FIRST(&e->env_ipc_senders)) != NULL) {
+		TAILQ_REMOVE(&e->env_ipc_senders, s, env_ipc_link);
+		s->env_ipc_sendto = 0;
+		s->env_ipc_calling = 0;
+		s->env_tf.tf_regs.reg_eax = -E_BAD_ENV;
+		sched_set_status(s, ENV_RUNNABLE);
+	}
+	// Fail the calls waiting for our reply.
+	while ((s = TAILQ_FIRST(&e->env_ipc_callers)) != NULL) {
+		TAILQ_REMOVE(&e->env_ipc_callers, s, env_ipc_reply_link);
+		s->env_ipc_recving = 0;
+		s->env_ipc_recv_from = 0;
+		s->env_tf.tf_regs.reg_eax = -E_BAD_ENV;
+		sched_set_status(s, ENV_RUNNABLE);
+	}
+	env_ipc_cancel(e);
+	endpoint_env_free(e);
+	shm_env_free(e);
+
 	// If freeing the current environment, switch to boot_pgdir
 	// before freeing the page directory, just in case the page
 	// gets reused.
@@ -390,6 +484,13 @@ env_free(struct Env *e)
 		page_decref(pa2page(pa));
 	}
 
+	// free UINFO's page table and Envinfo page
+	pa = PTE_ADDR(e->env_pgdir[PDX(UINFO)]);
+	e->env_pgdir[PDX(UINFO)] = 0;
+	page_decref(pa2page(pa));
+	page_decref(pa2page(PADDR(e->env_info)));
+	e->env_info = NULL;
+
 	// free the page directory
 	pa = e->env_cr3;
 	e->env_pgdir = 0;
@@ -397,7 +498,7 @@ env_free(struct Env *e)
 	page_decref(pa2page(pa));
 
 	// return the environment to the free list
-	e->env_status = ENV_FREE;
+	sched_set_status(e, ENV_FREE);
 	LIST_INSERT_HEAD(&env_free_list, e, env_link);
 }
 
@@ -409,6 +510,14 @@ env_free(struct Env *e)
 void
 env_destroy(struct Env *e) 
 {
+	// If e is currently running on another CPU, we change its state
+	// to ENV_DYING.  A zombie environment will be freed the next time
+	// it traps to the kernel.
+	if (e != curenv && cpus[e->env_cpu].cpu_env == e) {
+		sched_set_status(e, ENV_DYING);
+		return;
+	}
+
 	env_free(e);
 
 	if (curenv == e) {
@@ -440,6 +549,37 @@ env_pop_tf(struct Trapframe *tf)
 	panic("iret failed");  /* mostly to placate the compiler */
 }
 
+// CPU time accounting.  On every kernel entry and exit the cycles since
+// the last one are charged to curenv, as user or kernel time, or to
+// the idle count if the kernel had halted with no curenv.  Each CPU
+// keeps its own stamp, in cpu_acct_stamp.
+
+uint64_t env_idle_cycles;
+
+// Called on entry to the kernel, from user mode or from sched_halt().
+void
+env_acct_enter(void)
+{
+	uint64_t now = read_tsc();
+
+	if (curenv)
+		curenv->env_user_cycles += now - thiscpu->cpu_acct_stamp;
+	else
+		env_idle_cycles += now - thiscpu->cpu_acct_stamp;
+	thiscpu->cpu_acct_stamp = now;
+}
+
+// Called on exit from the kernel, to user mode or to sched_halt().
+void
+env_acct_leave(void)
+{
+	uint64_t now = read_tsc();
+
+	if (curenv)
+		curenv->env_kern_cycles += now - thiscpu->cpu_acct_stamp;
+	thiscpu->cpu_acct_stamp = now;
+}
+
 //
 // Context switch from curenv to env e.
 // Note: if this is the first call to env_run, curenv is NULL.
@@ -450,7 +590,6 @@ env_run(struct Env *e)
 {
 	// Step 1: If this is a context switch (a new environment is running),
 	//	   then set 'curenv' to the new environment,
-	//	   update its 'env_runs' counter, and
 	//	   and use lcr3() to switch to its address space.
 	// Step 2: Use env_pop_tf() to restore the environment's
 	//         registers and drop into user mode in the
@@ -464,8 +603,14 @@ env_run(struct Env *e)
 	// LAB 3: Your code here.
 
     /* dprintfunc(); */
+    sysenter_save();
+    env_acct_leave();
     curenv = e;
-    lcr3((uint32_t) e->env_cr3);
+    // Resuming the env whose address space is loaded, say after a
+    // trap, needs no reload: page changes invalidate as they go.
+    if (rcr3() != e->env_cr3)
+        lcr3((uint32_t) e->env_cr3);
+    unlock_kernel();
     env_pop_tf(&e->env_tf);
 }
 
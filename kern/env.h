@@ -4,6 +4,7 @@
 #define JOS_KERN_ENV_H
 
 #include <inc/env.h>
+#include <kern/cpu.h>
 
 #ifndef JOS_MULTIENV
 // Change this value to 1 once you're allowing multiple environments
@@ -12,15 +13,21 @@
 #endif
 
 extern struct Env *envs;		// All environments
-extern struct Env *curenv;	    // Current environment
+#define curenv (thiscpu->cpu_env)		// Current environment
 
 LIST_HEAD(Env_list, Env);		// Declares 'struct Env_list'
+TAILQ_HEAD(Env_tailq, Env);		// Declares 'struct Env_tailq'
 
 void env_init(void);
 int  env_alloc(struct Env **e, envid_t parent_id);
 void env_free(struct Env *e);
 void env_create(uint8_t *binary, size_t size);
 void env_destroy(struct Env *e); // Does not return if e == curenv
+bool env_ipc_cancel(struct Env *e);
+
+extern uint64_t env_idle_cycles;	// Time spent halted
+void env_acct_enter(void);
+void env_acct_leave(void);
 
 int  envid2env(envid_t envid, struct Env **env_store, bool checkperm);
 // The following two functions do not return
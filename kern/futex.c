@@ -0,0 +1,62 @@
+// Futex wait queues.
+//
+// An environment blocked in sys_futex_wait waits on the physical
+// address of the word it named, so environments that map a shared page
+// at different addresses still meet on the same queue.  Waiters hang
+// off FUTEX_HASH FIFO queues hashed by that address; waking walks one
+// queue for the waiters on the exact address.
+
+#include <kern/env.h>
+#include <kern/sched.h>
+#include <kern/futex.h>
+
+#define FUTEX_HASH	64
+#define FUTEX_QUEUE(pa)	(&futex_queues[((pa) >> 2) % FUTEX_HASH])
+
+static struct Env_tailq futex_queues[FUTEX_HASH];
+
+void
+futex_init(void)
+{
+    int i;
+
+    for (i = 0; i < FUTEX_HASH; i++)
+        TAILQ_INIT(&futex_queues[i]);
+}
+
+// Queue e, which is blocking, on the word at physical address pa.
+void
+futex_wait(struct Env *e, physaddr_t pa)
+{
+    e->env_futex_pa = pa;
+    TAILQ_INSERT_TAIL(FUTEX_QUEUE(pa), e, env_futex_link);
+}
+
+// Wake up to n of the envs waiting on pa, longest waiting first.
+// Returns the number woken.
+int
+futex_wake(physaddr_t pa, int n)
+{
+    struct Env *e, *next;
+    int woken = 0;
+
+    for (e = TAILQ_FIRST(FUTEX_QUEUE(pa)); e && woken < n; e = next) {
+        next = TAILQ_NEXT(e, env_futex_link);
+        if (e->env_futex_pa != pa)
+            continue;
+        e->env_tf.tf_regs.reg_eax = 0;
+        sched_set_status(e, ENV_RUNNABLE);
+        woken++;
+    }
+    return woken;
+}
+
+// e stops waiting on its futex, if it was.
+void
+futex_cancel(struct Env *e)
+{
+    if (!e->env_futex_pa)
+        return;
+    TAILQ_REMOVE(FUTEX_QUEUE(e->env_futex_pa), e, env_futex_link);
+    e->env_futex_pa = 0;
+}
@@ -11,9 +11,15 @@
 #include <kern/env.h>
 #include <kern/trap.h>
 #include <kern/sched.h>
+#include <kern/endpoint.h>
+#include <kern/futex.h>
 #include <kern/picirq.h>
+#include <kern/cpu.h>
+#include <kern/spinlock.h>
 #include <kern/kdebug.h>
 
+static void boot_aps(void);
+
 void
 i386_init(void)
 {
@@ -36,17 +42,25 @@ i386_init(void)
 
 	// Lab 3 user environment initialization functions
 	env_init();
+	sched_init();
+	endpoint_init();
+	futex_init();
 	idt_init();
     msr_init();
 
-	// Lab 4 multitasking initialization functions
+	// Lab 4 multiprocessor initialization functions
+	mp_init();
 	pic_init();
 	kclock_init();
+	lapic_init();
+
+	// Acquire the big kernel lock before waking up APs
+	lock_kernel();
 
-	// Should always have an idle process as first one.
-	ENV_CREATE(user_idle);
+	// Starting non-boot CPUs
+	boot_aps();
 
-	// Start fs.
+	// Start fs.  It must be the first one, see env_alloc().
 	ENV_CREATE(fs_fs);
 
 	// Start init
@@ -63,6 +77,68 @@ i386_init(void)
 }
 
 
+// While boot_aps is booting a given CPU, it communicates the per-core
+// stack pointer that should be loaded by mpentry.S to that CPU in
+// this variable.
+void *mpentry_kstack;
+
+// Start the non-boot (AP) processors.
+static void
+boot_aps(void)
+{
+	extern unsigned char mpentry_start[], mpentry_end[];
+	void *code;
+	struct Cpu *c;
+
+	// Write entry code to unused memory at MPENTRY_PADDR
+	code = KADDR(MPENTRY_PADDR);
+	memmove(code, mpentry_start, mpentry_end - mpentry_start);
+
+	// mpentry.S turns paging on while it still runs at MPENTRY_PADDR,
+	// so map VA 0:4MB like VA KERNBASE for as long as APs are booting,
+	// just as i386_vm_init() did for us.
+	boot_pgdir[0] = boot_pgdir[PDX(KERNBASE)];
+
+	// Boot each AP one at a time
+	for (c = cpus; c < cpus + ncpu; c++) {
+		if (c == cpus + cpunum())  // We've started already.
+			continue;
+
+		// Tell mpentry.S what stack to use
+		mpentry_kstack = percpu_kstacks[c - cpus] + KSTKSIZE;
+		// Start the CPU at mpentry_start
+		lapic_startap(c->cpu_id, PADDR(code));
+		// Wait for the CPU to finish some basic setup in mp_main()
+		while(c->cpu_status != CPU_STARTED)
+			;
+	}
+
+	boot_pgdir[0] = 0;
+	lcr3(boot_cr3);
+	pmap_enable_global();
+}
+
+// Setup code for APs
+void
+mp_main(void)
+{
+	// We are on the kernel's page directory; now load its GDT.
+	i386_seg_init();
+	cprintf("SMP: CPU %d starting\n", cpunum());
+
+	lapic_init();
+	trap_init_percpu();
+	msr_init();
+	xchg(&thiscpu->cpu_status, CPU_STARTED); // tell boot_aps() we're up
+
+	// Now that we have finished some basic setup, take the big
+	// kernel lock and start running environments.
+	lock_kernel();
+	// boot_aps() has unmapped low memory by the time we get the lock.
+	pmap_enable_global();
+	sched_yield();
+}
+
 /*
  * Variable panicstr contains argument to first call to panic; used as flag
  * to indicate that the kernel has already called panic.
@@ -113,7 +189,7 @@ msr_init()
     extern void sysenter_handler();
 
     wrmsr(0x174, GD_KT, 0);
-    wrmsr(0x175, KSTACKTOP, 0);
+    wrmsr(0x175, KSTACKTOP_CPU(cpunum()), 0);
     wrmsr(0x176, sysenter_handler, 0);
 
     dump_msr();
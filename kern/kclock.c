@@ -12,7 +12,12 @@
 
 #include <kern/kclock.h>
 #include <kern/picirq.h>
+#include <kern/pmap.h>
 
+#define	TSC_CALIBRATE_MS	50
+
+uint64_t tsc_freq;		/* TSC cycles per second */
+uint64_t tsc_boot;		/* TSC when the clock was set up */
 
 unsigned
 mc146818_read(unsigned reg)
@@ -29,13 +34,73 @@ mc146818_write(unsigned reg, unsigned datum)
 }
 
 
+/* Interrupt KCLOCK_HZ times/sec. */
+void
+kclock_periodic(void)
+{
+	outb(TIMER_MODE, TIMER_SEL0 | TIMER_RATEGEN | TIMER_16BIT);
+	outb(IO_TIMER1, TIMER_DIV(KCLOCK_HZ) % 256);
+	outb(IO_TIMER1, TIMER_DIV(KCLOCK_HZ) / 256);
+}
+
+/* Interrupt once, 'ticks' clock ticks from now, and then stay quiet
+ * until the next kclock_periodic() or kclock_oneshot().  The counter
+ * is only 16 bits wide, so this may have to settle for fewer ticks.
+ * Returns the number of ticks actually programmed.
+ */
+unsigned
+kclock_oneshot(unsigned ticks)
+{
+	unsigned max = 0xffff / TIMER_DIV(KCLOCK_HZ);
+
+	if (ticks > max)
+		ticks = max;
+	outb(TIMER_MODE, TIMER_SEL0 | TIMER_INTTC | TIMER_16BIT);
+	outb(IO_TIMER1, (ticks * TIMER_DIV(KCLOCK_HZ)) % 256);
+	outb(IO_TIMER1, (ticks * TIMER_DIV(KCLOCK_HZ)) / 256);
+	return ticks;
+}
+
+/* Clock ticks since kclock_init(), by the TSC, which every CPU agrees
+ * on whether or not its timer has been interrupting it.
+ */
+uint32_t
+kclock_ticks(void)
+{
+	return (read_tsc() - tsc_boot) / (tsc_freq / KCLOCK_HZ);
+}
+
+/* Count TSC cycles over TSC_CALIBRATE_MS milliseconds, timed by
+ * counter 2, whose gate and output are wired to the PPI port.
+ */
+static void
+tsc_calibrate(void)
+{
+	unsigned count = TIMER_DIV(1000) * TSC_CALIBRATE_MS;
+	uint64_t start;
+
+	outb(IO_PPI, (inb(IO_PPI) & ~0x02) | 0x01);	/* speaker off, gate on */
+	outb(TIMER_MODE, TIMER_SEL2 | TIMER_INTTC | TIMER_16BIT);
+	outb(TIMER_CNTR2, count % 256);
+	outb(TIMER_CNTR2, count / 256);
+	start = read_tsc();
+	while (!(inb(IO_PPI) & 0x20))	/* counter 2 output */
+		/* do nothing */;
+	tsc_boot = read_tsc();
+	tsc_freq = (tsc_boot - start) * (1000 / TSC_CALIBRATE_MS);
+	cprintf("	TSC runs at %llu kHz\n", tsc_freq / 1000);
+}
+
 void
 kclock_init(void)
 {
+	tsc_calibrate();
+	kinfo.ki_hz = KCLOCK_HZ;
+	kinfo.ki_tsc_freq = tsc_freq;
+	kinfo.ki_tsc_boot = tsc_boot;
+
 	/* initialize 8253 clock to interrupt 100 times/sec */
-	outb(TIMER_MODE, TIMER_SEL0 | TIMER_RATEGEN | TIMER_16BIT);
-	outb(IO_TIMER1, TIMER_DIV(100) % 256);
-	outb(IO_TIMER1, TIMER_DIV(100) / 256);
+	kclock_periodic();
 	cprintf("	Setup timer interrupts via 8259A\n");
 	irq_setmask_8259A(irq_mask_8259A & ~(1<<0));
 	cprintf("	unmasked timer interrupt\n");
@@ -6,8 +6,12 @@
 # error "This is a JOS kernel header; user programs should not #include it"
 #endif
 
+#include <inc/types.h>
+
 #define	IO_RTC		0x070		/* RTC port */
 
+#define	KCLOCK_HZ	100		/* Timer interrupts per second */
+
 #define	MC_NVRAM_START	0xe	/* start of NVRAM: offset 14 */
 #define	MC_NVRAM_SIZE	50	/* 50 bytes of NVRAM */
 
@@ -26,8 +30,14 @@
 /* NVRAM byte 36: current century.  (please increment in Dec99!) */
 #define NVRAM_CENTURY	(MC_NVRAM_START + 36)	/* RTC offset 0x32 */
 
+extern uint64_t tsc_freq;
+extern uint64_t tsc_boot;
+
 unsigned mc146818_read(unsigned reg);
 void mc146818_write(unsigned reg, unsigned datum);
 void kclock_init(void);
+void kclock_periodic(void);
+unsigned kclock_oneshot(unsigned ticks);
+uint32_t kclock_ticks(void);
 
 #endif	// !JOS_KERN_KCLOCK_H
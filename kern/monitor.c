@@ -11,6 +11,11 @@
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
 #include <kern/trap.h>
+#include <kern/sched.h>
+#include <kern/env.h>
+#include <kern/kclock.h>
+#include <kern/syscall.h>
+#include <kern/cpu.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -25,6 +30,9 @@ struct Command {
 static struct Command commands[] = {
 	{ "help", "Display this list of commands", mon_help },
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
+	{ "schedstat", "Display scheduler statistics", mon_schedstat },
+	{ "top", "Display environments by CPU time used", mon_top },
+	{ "syscalls", "Display syscall counts and latencies [syscall]", mon_syscalls },
 };
 #define NCOMMANDS (sizeof(commands)/sizeof(commands[0]))
 
@@ -57,6 +65,113 @@ mon_kerninfo(int argc, char **argv, struct Trapframe *tf)
 	return 0;
 }
 
+int
+mon_schedstat(int argc, char **argv, struct Trapframe *tf)
+{
+    cprintf("scheduling decisions: %llu\n", sched_switches);
+    cprintf("cycles in scheduler:  %llu\n", sched_cycles);
+    if (sched_switches)
+        cprintf("cycles per decision:  %llu\n", sched_cycles / sched_switches);
+    return 0;
+}
+
+static uint64_t
+env_cycles(struct Env *e)
+{
+    return e->env_user_cycles + e->env_kern_cycles;
+}
+
+static uint64_t
+cycles_to_ms(uint64_t cycles)
+{
+    return cycles / (tsc_freq / 1000 ? tsc_freq / 1000 : 1);
+}
+
+int
+mon_top(int argc, char **argv, struct Trapframe *tf)
+{
+    static struct Env *sorted[NENV];
+    uint64_t elapsed = read_tsc() - tsc_boot;
+    unsigned permille;
+    struct Env *e;
+    int i, j, n;
+
+    // Insertion sort by CPU time, most first.
+    n = 0;
+    for (i = 0; i < NENV; i++) {
+        e = &envs[i];
+        if (e->env_status == ENV_FREE)
+            continue;
+        for (j = n++; j > 0 && env_cycles(sorted[j - 1]) < env_cycles(e); j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = e;
+    }
+
+    // Every CPU adds to the idle time, so it is a share of all of
+    // them; an env only ever runs on one CPU at a time.
+    permille = env_idle_cycles * 1000 / (elapsed * ncpu);
+    cprintf("up %llu ms, idle %llu ms (%u.%u%% of %d CPUs), "
+            "%d environments\n",
+            cycles_to_ms(elapsed), cycles_to_ms(env_idle_cycles),
+            permille / 10, permille % 10, ncpu, n);
+    cprintf("ENVID    STATUS       RUNS SYSCALLS    TRAPS  PGFLTS "
+            "  USER(ms)   KERN(ms)   %%CPU\n");
+    for (i = 0; i < n; i++) {
+        e = sorted[i];
+        permille = env_cycles(e) * 1000 / elapsed;
+        cprintf("%08x %-8s %8u %8u %8u %7u %10llu %10llu %4u.%u\n",
+                e->env_id,
+                e->env_status == ENV_RUNNABLE ? "runnable" : "blocked",
+                e->env_runs, e->env_syscalls, e->env_traps, e->env_pgfaults,
+                cycles_to_ms(e->env_user_cycles),
+                cycles_to_ms(e->env_kern_cycles),
+                permille / 10, permille % 10);
+    }
+    return 0;
+}
+
+// Without arguments, list every syscall made so far with its count and
+// average latency.  With a syscall name, show its latency histogram and
+// which environments make it.
+int
+mon_syscalls(int argc, char **argv, struct Trapframe *tf)
+{
+    struct Syscall_stats *ss = &syscall_stats;
+    uint64_t timed;
+    int i, num;
+
+    if (argc < 2) {
+        cprintf("SYSCALL                    CALLS     AVG(cyc)\n");
+        for (i = 0; i < NSYSCALLS; i++) {
+            if (!ss->ss_count[i])
+                continue;
+            for (timed = 0, num = 0; num < NSYSHIST; num++)
+                timed += ss->ss_hist[i][num];
+            cprintf("%-22s %10llu %12llu\n", syscall_names[i],
+                    ss->ss_count[i], timed ? ss->ss_cycles[i] / timed : 0);
+        }
+        return 0;
+    }
+
+    for (num = 0; num < NSYSCALLS; num++)
+        if (strcmp(argv[1], syscall_names[num]) == 0)
+            break;
+    if (num == NSYSCALLS) {
+        cprintf("no syscall named %s\n", argv[1]);
+        return 0;
+    }
+    cprintf("%s: %llu calls\n", syscall_names[num], ss->ss_count[num]);
+    for (i = 0; i < NSYSHIST; i++)
+        if (ss->ss_hist[num][i])
+            cprintf("  %10u-%-10u cycles %10u\n", i ? 1u << i : 0,
+                    (1u << i) * 2 - 1, ss->ss_hist[num][i]);
+    for (i = 0; i < NENV; i++)
+        if (envs[i].env_status != ENV_FREE && envs[i].env_syscall_count[num])
+            cprintf("  env %08x %10u calls\n", envs[i].env_id,
+                    envs[i].env_syscall_count[num]);
+    return 0;
+}
+
 int
 mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 {
@@ -5,11 +5,15 @@
 #include <inc/error.h>
 #include <inc/string.h>
 #include <inc/assert.h>
+#include <inc/trap.h>
 
 #include <kern/pmap.h>
 #include <kern/kclock.h>
 #include <kern/env.h>
+#include <kern/cpu.h>
+#include <kern/picirq.h>
 #include <kern/kdebug.h>
+#include <kern/syscall.h>
 
 // These variables are set by i386_detect_memory()
 static physaddr_t maxpa;	// Maximum physical address
@@ -25,6 +29,9 @@ static char* boot_freemem;	// Pointer to next byte of free mem
 struct Page* pages;		// Virtual address of physical page array
 static struct Page_list page_free_list;	// Free list of physical pages
 
+// Mapped read-only for users at UKINFO, so it gets a page of its own.
+struct Kinfo kinfo __attribute__((aligned(PGSIZE)));
+
 // Global descriptor table.
 //
 // The kernel and user segments are identical (except for the DPL).
@@ -48,8 +55,11 @@ struct Segdesc gdt[] =
 	// 0x20 - user data segment
 	[GD_UD >> 3] = SEG(STA_W, 0x0, 0xffffffff, 3),
 
-	// 0x28 - tss, initialized in idt_init()
-	[GD_TSS >> 3] = SEG_NULL
+	// Per-CPU TSS descriptors (starting from GD_TSS0) are initialized
+	// in trap_init_percpu()
+	[GD_TSS0 >> 3] = SEG_NULL,
+
+	[(GD_TSS0 >> 3) + NCPU - 1] = SEG_NULL
 };
 
 struct Pseudodesc gdt_pd = {
@@ -217,17 +227,33 @@ i386_vm_init(void)
 	//    - the new image at UENVS  -- kernel R, user R
 	//    - envs itself -- kernel RW, user NONE
     boot_map_segment(pgdir, UENVS, NENV * sizeof(struct Env), PADDR(envs), PTE_U);
+
+	//////////////////////////////////////////////////////////////////////
+	// Map 'kinfo' read-only by the user at UKINFO.  Each env gets its
+	// own copy of this page table, see env_setup_vm().
+	// Permissions: kernel R, user R
+    boot_map_segment(pgdir, UKINFO, PGSIZE, PADDR(&kinfo), PTE_U);
+
+	//////////////////////////////////////////////////////////////////////
+	// Map the syscall statistics read-only by the user at USYSSTATS.
+	// Permissions: kernel R, user R
+    boot_map_segment(pgdir, USYSSTATS, ROUNDUP(sizeof(syscall_stats), PGSIZE),
+                     PADDR(&syscall_stats), PTE_U);
     
 	//////////////////////////////////////////////////////////////////////
-    // Use the physical memory that bootstack refers to as
-    // the kernel stack.  The complete VA
-	// range of the stack, [KSTACKTOP-PTSIZE, KSTACKTOP), breaks into two
-	// pieces:
-	//     * [KSTACKTOP-KSTKSIZE, KSTACKTOP) -- backed by physical memory
-	//     * [KSTACKTOP-PTSIZE, KSTACKTOP-KSTKSIZE) -- not backed => faults
+	// Map the per-CPU kernel stacks.  CPU i's stack grows down from
+	// KSTACKTOP_CPU(i), CPU 0 using the physical memory that bootstack
+	// refers to.  Each stack is followed by a KSTKGAP guard that is not
+	// backed, so an overflow faults instead of running into the next
+	// CPU's stack.
 	//     Permissions: kernel RW, user NONE
-	// Your code goes here:
-    boot_map_segment(pgdir, KSTACKTOP-KSTKSIZE, KSTKSIZE, PADDR(bootstack), PTE_W);
+	// Mappings that are the same in every address space and only the
+	// kernel uses are global, so they stay in the TLB across lcr3.
+    boot_map_segment(pgdir, KSTACKTOP-KSTKSIZE, KSTKSIZE, PADDR(bootstack),
+                     PTE_W|PTE_G);
+    for (n = 1; n < NCPU; n++)
+        boot_map_segment(pgdir, KSTACKTOP_CPU(n) - KSTKSIZE, KSTKSIZE,
+                         PADDR(percpu_kstacks[n]), PTE_W|PTE_G);
 
 	//////////////////////////////////////////////////////////////////////
 	// Map all of physical memory at KERNBASE. 
@@ -237,7 +263,7 @@ i386_vm_init(void)
 	// we just set up the amapping anyway.
 	// Permissions: kernel RW, user NONE
 	// Your code goes here:
-    boot_map_segment(pgdir, KERNBASE, 0xFFFFFFF, 0, PTE_W|PTE_P);
+    boot_map_segment(pgdir, KERNBASE, 0xFFFFFFF, 0, PTE_W|PTE_P|PTE_G);
 
 	// Check that the initial page directory has been set up correctly.
 	check_boot_pgdir();
@@ -273,14 +299,7 @@ i386_vm_init(void)
 	// (x < 4MB so uses paging pgdir[0])
 
 	// Reload all segment registers.
-	asm volatile("lgdt gdt_pd");
-	asm volatile("movw %%ax,%%gs" :: "a" (GD_UD|3));
-	asm volatile("movw %%ax,%%fs" :: "a" (GD_UD|3));
-	asm volatile("movw %%ax,%%es" :: "a" (GD_KD));
-	asm volatile("movw %%ax,%%ds" :: "a" (GD_KD));
-	asm volatile("movw %%ax,%%ss" :: "a" (GD_KD));
-	asm volatile("ljmp %0,$1f\n 1:\n" :: "i" (GD_KT));  // reload cs
-	asm volatile("lldt %%ax" :: "a" (0));
+	i386_seg_init();
 
 	// Final mapping: KERNBASE+x => KERNBASE+x => x.
 
@@ -292,6 +311,44 @@ i386_vm_init(void)
 	lcr3(boot_cr3);
 }
 
+// Load the kernel's GDT and segments.  The boot CPU does this once it
+// has paging on; the other CPUs do it in mp_main().
+void
+i386_seg_init(void)
+{
+	asm volatile("lgdt gdt_pd");
+	asm volatile("movw %%ax,%%gs" :: "a" (GD_UD|3));
+	asm volatile("movw %%ax,%%fs" :: "a" (GD_UD|3));
+	asm volatile("movw %%ax,%%es" :: "a" (GD_KD));
+	asm volatile("movw %%ax,%%ds" :: "a" (GD_KD));
+	asm volatile("movw %%ax,%%ss" :: "a" (GD_KD));
+	asm volatile("ljmp %0,$1f\n 1:\n" :: "i" (GD_KT));  // reload cs
+	asm volatile("lldt %%ax" :: "a" (0));
+}
+
+//
+// Reserve size bytes in the MMIO region and map [pa,pa+size) at this
+// location, uncached.  Return the base of the reserved region.  size
+// does *not* have to be multiple of PGSIZE.
+//
+// Everything must be mapped before the first environment is created,
+// since env_setup_vm() only copies the kernel's page directory.
+//
+void *
+mmio_map_region(physaddr_t pa, size_t size)
+{
+	static uintptr_t base = MMIOBASE;
+	uintptr_t va = base;
+
+	size = ROUNDUP(pa + size, PGSIZE) - ROUNDDOWN(pa, PGSIZE);
+	if (base + size > MMIOLIM)
+		panic("mmio_map_region: overflow MMIOLIM");
+	boot_map_segment(boot_pgdir, base, size, ROUNDDOWN(pa, PGSIZE),
+			 PTE_PCD|PTE_PWT|PTE_W|PTE_G);
+	base += size;
+	return (void *) (va + PGOFF(pa));
+}
+
 //
 // Check the physical page allocator (page_alloc(), page_free(),
 // and page_init()).
@@ -386,9 +443,16 @@ check_boot_pgdir(void)
 	for (i = 0; i < npage * PGSIZE; i += PGSIZE)
 		assert(check_va2pa(pgdir, KERNBASE + i) == i);
 
-	// check kernel stack
+	// check kernel stacks
 	for (i = 0; i < KSTKSIZE; i += PGSIZE)
 		assert(check_va2pa(pgdir, KSTACKTOP - KSTKSIZE + i) == PADDR(bootstack) + i);
+	for (n = 1; n < NCPU; n++) {
+		for (i = 0; i < KSTKSIZE; i += PGSIZE)
+			assert(check_va2pa(pgdir, KSTACKTOP_CPU(n) - KSTKSIZE + i)
+			       == PADDR(percpu_kstacks[n]) + i);
+		for (i = 0; i < KSTKGAP; i += PGSIZE)
+			assert(check_va2pa(pgdir, KSTACKTOP_CPU(n) + KSTKGAP - i - PGSIZE) == ~0);
+	}
 
 	// check for zero/non-zero in PDEs
 	for (i = 0; i < NPDENTRIES; i++) {
@@ -398,6 +462,7 @@ check_boot_pgdir(void)
 		case PDX(KSTACKTOP-1):
 		case PDX(UPAGES):
 		case PDX(UENVS):
+		case PDX(UINFO):
 			assert(pgdir[i]);
 			break;
 		default:
@@ -477,6 +542,10 @@ page_init(void)
         page = pa2page(addr);
         LIST_REMOVE(page, pp_link);
     }        
+
+    kinfo.ki_free_pages = 0;
+    LIST_FOREACH(page, &page_free_list, pp_link)
+        kinfo.ki_free_pages++;
 }
 
 //
@@ -516,6 +585,7 @@ page_alloc(struct Page **pp_store)
 
     page = LIST_FIRST(&page_free_list);
     LIST_REMOVE(page, pp_link);
+    kinfo.ki_free_pages--;
     page_initpp(page);
     *pp_store = page;
     return 0;
@@ -534,6 +604,7 @@ page_free(struct Page *pp)
         dprintk("page_free: pp->pp_ref of page %p is %d\n", page2pa(pp), pp->pp_ref);
     }
     LIST_INSERT_HEAD(&page_free_list, pp, pp_link);
+    kinfo.ki_free_pages++;
 }
 
 //
@@ -625,7 +696,6 @@ page_insert(pde_t *pgdir, struct Page *pp, void *va, int perm)
     if (pte != 0 && *pte != 0 && pa2page(PTE_ADDR(*pte)) != pp) {
         dprintk("page_insert: pte=%p, already mapped, remove first.\n", *pte);
         page_remove(pgdir, va);
-        tlb_invalidate(pgdir, va);
     }
 
     if (!pte)
@@ -633,6 +703,8 @@ page_insert(pde_t *pgdir, struct Page *pp, void *va, int perm)
     if (pa2page(PTE_ADDR(*pte)) != pp) 
         pp->pp_ref ++;
     *pte = (page2pa(pp) & ~0xFFF) | perm | PTE_P;
+    // The same page may have been mapped with other permissions.
+    tlb_invalidate(pgdir, va);
     /* dprintk("page_insert: pgdir=%p, va=%p\n", pgdir, va); */
     /* dprintk("             pte ptr=%p, pte val=%p, pp_ref=%d\n", pte, *pte, pp->pp_ref); */
 
@@ -714,21 +786,316 @@ page_remove(pde_t *pgdir, void *va)
     if (!pp)
         return;
     /* dprintk("[PAGE] remove page va=%p\n", va); */
-    page_decref(pp);
     *pte = 0;
     tlb_invalidate(pgdir, va);
+    page_decref(pp);
+}
+
+//
+// Move the page mapped at 'srcva' in 'srcdir' to 'dstva' in 'dstdir',
+// with permissions 'perm|PTE_P', and unmap it at srcva.  Whatever
+// was mapped at dstva is removed.  The page keeps its reference
+// count, as it is still mapped once by the same owner.
+//
+// RETURNS:
+//   0 on success
+//   -E_INVAL, if nothing is mapped at srcva
+//   -E_NO_MEM, if page table couldn't be allocated
+//
+int
+page_move(pde_t *srcdir, void *srcva, pde_t *dstdir, void *dstva, int perm)
+{
+    struct Page *pp;
+    pte_t *srcpte, *dstpte;
+
+    if (!(pp = page_lookup(srcdir, srcva, &srcpte)))
+        return -E_INVAL;
+    if (!(dstpte = pgdir_walk(dstdir, dstva, 1)))
+        return -E_NO_MEM;
+    if (dstpte == srcpte) {
+        *dstpte = page2pa(pp) | perm | PTE_P;
+        tlb_invalidate(dstdir, dstva);
+        return 0;
+    }
+    page_remove(dstdir, dstva);
+    *srcpte = 0;
+    tlb_invalidate(srcdir, srcva);
+    *dstpte = page2pa(pp) | perm | PTE_P;
+    return 0;
+}
+
+//
+// Range versions of page_alloc plus page_insert, page_insert and
+// page_remove, for the range system calls.  They visit each page table
+// once, stepping through its entries instead of walking the page
+// directory for every page, and invalidate the TLB once for the whole
+// range, with tlb_invalidate_range.  'va' and 'len' must be
+// page-aligned.
+//
+
+// Return the PTE for 'va' given 'prev', the PTE for the page before it
+// or NULL, allocating the page table if 'create' is set.
+static pte_t *
+pgdir_walk_next(pde_t *pgdir, uintptr_t va, pte_t *prev, int create)
+{
+    if (prev && PTX(va) != 0)
+        return prev + 1;
+    return pgdir_walk(pgdir, (void *) va, create);
+}
+
+// Allocate all the page tables covering [va, va+len).
+static int
+pgdir_walk_range(pde_t *pgdir, uintptr_t va, size_t len)
+{
+    uintptr_t end = va + len;
+
+    for (va = ROUNDDOWN(va, PTSIZE); va < end; va += PTSIZE)
+        if (!pgdir_walk(pgdir, (void *) va, 1))
+            return -E_NO_MEM;
+    return 0;
+}
+
+// Drop a reference to 'pp', which has just been unmapped.  If it was
+// the last, put the page on 'dead' instead of freeing it: other CPUs
+// may still reach it through their TLBs until tlb_invalidate_range().
+static void
+page_decref_dead(struct Page *pp, struct Page_list *dead)
+{
+    if (--pp->pp_ref == 0)
+        LIST_INSERT_HEAD(dead, pp, pp_link);
 }
 
+// Free all the pages on 'list'.
+static void
+page_free_list_all(struct Page_list *list)
+{
+    struct Page *pp;
+
+    while ((pp = LIST_FIRST(list))) {
+        LIST_REMOVE(pp, pp_link);
+        page_free(pp);
+    }
+}
+
+// Point '*pte' at 'pp' with permissions 'perm|PTE_P', as page_insert
+// does.  A page this unmaps goes to 'dead', see page_decref_dead().
+static void
+pte_insert(pte_t *pte, struct Page *pp, int perm, struct Page_list *dead)
+{
+    if (!(*pte & PTE_P))
+        pp->pp_ref++;
+    else if (pa2page(PTE_ADDR(*pte)) != pp) {
+        page_decref_dead(pa2page(PTE_ADDR(*pte)), dead);
+        pp->pp_ref++;
+    }
+    *pte = page2pa(pp) | perm | PTE_P;
+}
+
+//
+// Map zeroed pages at every page of [va, va+len) in 'pgdir', with
+// permissions 'perm|PTE_P'.  Whatever was mapped there is removed.
 //
-// Invalidate a TLB entry, but only if the page tables being
-// edited are the ones currently in use by the processor.
+// RETURNS:
+//   0 on success
+//   -E_NO_MEM, if there are not enough pages, or page tables couldn't
+//     be allocated; nothing is mapped then
+//
+int
+page_alloc_range(pde_t *pgdir, uintptr_t va, size_t len, int perm)
+{
+    struct Page_list pages, dead;
+    struct Page *pp;
+    uintptr_t end = va + len;
+    pte_t *pte = NULL;
+    size_t i;
+
+    // Take all the pages first, so that nothing below can fail.
+    LIST_INIT(&pages);
+    for (i = 0; i < len; i += PGSIZE) {
+        if (page_alloc(&pp) < 0)
+            goto nomem;
+        LIST_INSERT_HEAD(&pages, pp, pp_link);
+    }
+    if (pgdir_walk_range(pgdir, va, len) < 0)
+        goto nomem;
+
+    LIST_INIT(&dead);
+    for (; va < end; va += PGSIZE) {
+        pp = LIST_FIRST(&pages);
+        LIST_REMOVE(pp, pp_link);
+        memset(page2kva(pp), 0, PGSIZE);
+        pte = pgdir_walk_next(pgdir, va, pte, 0);
+        pte_insert(pte, pp, perm, &dead);
+    }
+    tlb_invalidate_range(pgdir, end - len, len);
+    page_free_list_all(&dead);
+    return 0;
+
+nomem:
+    page_free_list_all(&pages);
+    return -E_NO_MEM;
+}
+
+//
+// Map the pages mapped at [srcva, srcva+len) in 'srcdir' at
+// [dstva, dstva+len) in 'dstdir', with permissions 'perm|PTE_P'.
+// Mapping a range onto itself just changes its permissions.  The
+// ranges must not otherwise overlap.
+//
+// RETURNS:
+//   0 on success
+//   -E_INVAL, if a page of the source range is not mapped, or (perm &
+//     PTE_W) but it is read-only
+//   -E_NO_MEM, if page tables couldn't be allocated
+//   Nothing is mapped on error.
+//
+int
+page_map_range(pde_t *srcdir, uintptr_t srcva, pde_t *dstdir,
+               uintptr_t dstva, size_t len, int perm)
+{
+    struct Page_list dead;
+    pte_t *srcpte = NULL, *dstpte = NULL;
+    size_t i;
+
+    for (i = 0; i < len; i += PGSIZE) {
+        srcpte = pgdir_walk_next(srcdir, srcva + i, srcpte, 0);
+        if (!srcpte || !(*srcpte & PTE_P))
+            return -E_INVAL;
+        if ((perm & PTE_W) && !(*srcpte & PTE_W))
+            return -E_INVAL;
+    }
+    if (pgdir_walk_range(dstdir, dstva, len) < 0)
+        return -E_NO_MEM;
+
+    LIST_INIT(&dead);
+    srcpte = NULL;
+    for (i = 0; i < len; i += PGSIZE) {
+        srcpte = pgdir_walk_next(srcdir, srcva + i, srcpte, 0);
+        dstpte = pgdir_walk_next(dstdir, dstva + i, dstpte, 0);
+        pte_insert(dstpte, pa2page(PTE_ADDR(*srcpte)), perm, &dead);
+    }
+    tlb_invalidate_range(dstdir, dstva, len);
+    page_free_list_all(&dead);
+    return 0;
+}
+
+//
+// Unmap every page of [va, va+len) in 'pgdir'.  Unmapped pages are
+// skipped, as are whole missing page tables.
+//
+void
+page_remove_range(pde_t *pgdir, uintptr_t va, size_t len)
+{
+    struct Page_list dead;
+    uintptr_t end = va + len;
+    pte_t *pte = NULL;
+
+    LIST_INIT(&dead);
+    for (; va < end; va += PGSIZE) {
+        if (!(pte = pgdir_walk_next(pgdir, va, pte, 0))) {
+            // Go on from the start of the next page table.
+            va = ROUNDDOWN(va, PTSIZE) + PTSIZE - PGSIZE;
+            continue;
+        }
+        if (*pte & PTE_P) {
+            page_decref_dead(pa2page(PTE_ADDR(*pte)), &dead);
+            *pte = 0;
+        }
+    }
+    tlb_invalidate_range(pgdir, end - len, len);
+    page_free_list_all(&dead);
+}
+
+//
+// Have every other CPU that has 'pgdir' loaded flush its TLB, and wait
+// until all of them have, so that the caller may then free the pages
+// it unmapped.  Another CPU has an env's page directory loaded only
+// while that env is its cpu_env: sched_halt() and env_free() switch
+// to boot_cr3 first.  Such a CPU is in user mode, where trap() answers
+// the IRQ_TLB IPI, or waiting for the big kernel lock we hold, where
+// spin_lock() answers it.
+//
+static void
+tlb_shootdown(pde_t *pgdir)
+{
+    uint32_t pending = 0;
+    int i;
+
+    for (i = 0; i < ncpu; i++) {
+        if (i == cpunum() || !cpus[i].cpu_env ||
+            cpus[i].cpu_env->env_pgdir != pgdir)
+            continue;
+        cpus[i].cpu_tlb_flush = 1;
+        lapic_ipi(i, IRQ_OFFSET + IRQ_TLB);
+        pending |= 1 << i;
+    }
+    for (i = 0; i < ncpu; i++)
+        while ((pending & (1 << i)) && cpus[i].cpu_tlb_flush)
+            asm volatile("pause");
+}
+
+//
+// Flush this CPU's TLB if tlb_shootdown() asked it to.  The kernel's
+// mappings are global and survive.
+//
+void
+tlb_shootdown_ack(void)
+{
+    if (thiscpu->cpu_tlb_flush) {
+        tlbflush();
+        thiscpu->cpu_tlb_flush = 0;
+    }
+}
+
+//
+// Invalidate a TLB entry, on this CPU if the page tables being edited
+// are the ones it uses, and on every other CPU that uses them.
 //
 void
 tlb_invalidate(pde_t *pgdir, void *va)
 {
 	// Flush the entry only if we're modifying the current address space.
-	if (!curenv || curenv->env_pgdir == pgdir)
+	if (PADDR(pgdir) == rcr3())
 		invlpg(va);
+	tlb_shootdown(pgdir);
+}
+
+//
+// Invalidate the TLB entries for [va, va+len) like tlb_invalidate.
+// Past TLB_INVLPG_MAX pages it is cheaper to reload %cr3, which only
+// drops the user mappings since the kernel's are global.
+//
+void
+tlb_invalidate_range(pde_t *pgdir, uintptr_t va, size_t len)
+{
+    uintptr_t end = va + len;
+
+    tlb_shootdown(pgdir);
+    if (PADDR(pgdir) != rcr3())
+        return;
+    if (len > TLB_INVLPG_MAX * PGSIZE) {
+        tlbflush();
+        return;
+    }
+    for (; va < end; va += PGSIZE)
+        invlpg((void *) va);
+}
+
+//
+// Turn on global pages on this CPU, if it has them, so that the
+// kernel's PTE_G mappings survive %cr3 reloads.  Changing CR4_PGE
+// flushes the whole TLB, global entries included.  Call this only
+// once nothing maps low memory through the kernel's page tables, as
+// i386_vm_init() and boot_aps() do for a while.
+//
+void
+pmap_enable_global(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (edx & (1 << 13))	// PGE
+        lcr4(rcr4() | CR4_PGE);
 }
 
 static uintptr_t user_mem_check_addr;
@@ -765,16 +1132,16 @@ user_mem_check(struct Env *env, const void *va, size_t len, int perm)
     /*     return 0; */
     /* } */
     
-    if (vaddr > ULIM) {
-        user_mem_check_addr = vaddr;
+    if (vaddr >= ULIM || len > ULIM - vaddr) {
+        user_mem_check_addr = MAX(vaddr, ULIM);
         return -E_FAULT;
     }
         
     while (start < end) {
         pp = page_lookup(env->env_pgdir, (void *) start, &pte);
-        flags = (*pte) & 0xFFF;
+        flags = pp ? *pte & 0xFFF : 0;
         if (!pp || (perm & (~flags)) > 0) {
-            user_mem_check_addr = vaddr;
+            user_mem_check_addr = MAX(vaddr, start);
             return -E_FAULT;
         }
         start += PGSIZE;
@@ -783,6 +1150,40 @@ user_mem_check(struct Env *env, const void *va, size_t len, int perm)
 	return 0;
 }
 
+// Copy 'len' bytes from user address 'usrc' in the current address
+// space to 'dst'.  Rather than walking the page table first, this
+// just copies, and a page fault on usrc makes it fail; see
+// kern/usercopy.S.  As with user_mem_check, a read-only page is as
+// good as a writable one.
+//
+// Returns 0 on success, -E_FAULT if any of [usrc, usrc+len) is above
+// ULIM or not mapped.
+int
+copyin(void *dst, const void *usrc, size_t len)
+{
+    uintptr_t va = (uintptr_t) usrc;
+
+    if (va >= ULIM || len > ULIM - va)
+        return -E_FAULT;
+    return user_memcpy(dst, usrc, len);
+}
+
+// Copy 'len' bytes from 'src' to user address 'udst' in the current
+// address space, like copyin.  Since CR0_WP is set, this also fails
+// on read-only and copy-on-write pages.
+//
+// Returns 0 on success, -E_FAULT if any of [udst, udst+len) is above
+// ULIM or not mapped writable.
+int
+copyout(void *udst, const void *src, size_t len)
+{
+    uintptr_t va = (uintptr_t) udst;
+
+    if (va >= ULIM || len > ULIM - va)
+        return -E_FAULT;
+    return user_memcpy(udst, src, len);
+}
+
 //
 // Checks that environment 'env' is allowed to access the range
 // of memory [va, va+len) with permissions 'perm | PTE_U'.
@@ -792,11 +1193,20 @@ user_mem_check(struct Env *env, const void *va, size_t len, int perm)
 void
 user_mem_assert(struct Env *env, const void *va, size_t len, int perm)
 {
-	if (user_mem_check(env, va, len, perm | PTE_U) < 0) {
-		cprintf("[%08x] user_mem_check assertion failure for "
-			"va %08x\n", curenv->env_id, user_mem_check_addr);
-		env_destroy(env);	// may not return
-	}
+	if (user_mem_check(env, va, len, perm | PTE_U) < 0)
+		user_mem_fault(env, (void *) user_mem_check_addr);
+}
+
+//
+// Destroys environment 'env' for passing the bad address 'va' to the
+// kernel, as user_mem_assert does.  For use when copyin and friends fail.
+//
+void
+user_mem_fault(struct Env *env, const void *va)
+{
+	cprintf("[%08x] user_mem_check assertion failure for "
+		"va %08x\n", curenv->env_id, va);
+	env_destroy(env);	// may not return
 }
 
 // check page_insert, page_remove, &c
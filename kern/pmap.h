@@ -8,6 +8,7 @@
 
 #include <inc/memlayout.h>
 #include <inc/assert.h>
+#include <inc/kinfo.h>
 struct Env;
 
 
@@ -45,10 +46,14 @@ extern size_t npage;
 extern physaddr_t boot_cr3;
 extern pde_t *boot_pgdir;
 
+extern struct Kinfo kinfo;
+
 extern struct Segdesc gdt[];
 extern struct Pseudodesc gdt_pd;
 
 void	i386_vm_init();
+void	i386_seg_init(void);
+void	*mmio_map_region(physaddr_t pa, size_t size);
 void	i386_detect_memory();
 
 void page_init(void);
@@ -56,13 +61,29 @@ int  page_alloc(struct Page **pp_store);
 void page_free(struct Page *pp);
 int  page_insert(pde_t *pgdir, struct Page *pp, void *va, int perm);
 void page_remove(pde_t *pgdir, void *va);
+int  page_move(pde_t *srcdir, void *srcva, pde_t *dstdir, void *dstva, int perm);
+int  page_alloc_range(pde_t *pgdir, uintptr_t va, size_t len, int perm);
+int  page_map_range(pde_t *srcdir, uintptr_t srcva, pde_t *dstdir,
+                    uintptr_t dstva, size_t len, int perm);
+void page_remove_range(pde_t *pgdir, uintptr_t va, size_t len);
 struct Page *page_lookup(pde_t *pgdir, void *va, pte_t **pte_store);
 void	page_decref(struct Page *pp);
 
+// Ranges of more pages than this are invalidated with a TLB flush.
+#define TLB_INVLPG_MAX	32
+
 void	tlb_invalidate(pde_t *pgdir, void *va);
+void	tlb_invalidate_range(pde_t *pgdir, uintptr_t va, size_t len);
+void	tlb_shootdown_ack(void);
+void	pmap_enable_global(void);
 
 int	user_mem_check(struct Env *env, const void *va, size_t len, int perm);
 void	user_mem_assert(struct Env *env, const void *va, size_t len, int perm);
+void	user_mem_fault(struct Env *env, const void *va);
+int	copyin(void *dst, const void *usrc, size_t len);
+int	copyout(void *udst, const void *src, size_t len);
+// In kern/usercopy.S, for copyin and copyout.
+int	user_memcpy(void *dst, const void *src, size_t len);
 
 static inline ppn_t
 page2ppn(struct Page *pp)
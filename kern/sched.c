@@ -1,58 +1,666 @@
 #include <inc/assert.h>
+#include <inc/error.h>
+#include <inc/x86.h>
 
 #include <kern/env.h>
 #include <kern/pmap.h>
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
 #include <kern/trap.h>
+#include <kern/kclock.h>
+#include <kern/picirq.h>
+#include <kern/cpu.h>
+#include <kern/spinlock.h>
+#include <kern/timer.h>
+#include <kern/syscall.h>
+#include <kern/endpoint.h>
+#include <kern/futex.h>
+#include <kern/sched.h>
 
 #if defined(DEBUG_SCHED)
 #undef dprintk
 #define dprintk(_f, _a...)
 #endif
 
+// Multilevel feedback queue.
+//
+// Every ENV_RUNNABLE environment sits on a run queue.  The running
+// environment stays on its queue while it runs and is rotated to the
+// tail when it gives up the CPU.
+//
+//  - A band-b env may run for SCHED_QUANTUM(b) timer ticks before it is
+//    demoted to band b+1.  Ticks are kept across sys_yield, so yielding
+//    just before the quantum ends does not escape demotion.
+//  - An env that blocks in sys_ipc_recv before its quantum ends is
+//    promoted one band.
+//  - Every SCHED_BOOST_TICKS ticks all environments go back to band 0,
+//    so demoted CPU hogs cannot starve.
+//  - Pinned environments (sys_env_set_priority) never change band.
+//
+// Stride scheduling.
+//
+// Environments given tickets with sys_env_set_tickets leave the bands
+// for a proportional-share class.  Each has a stride inversely
+// proportional to its tickets and a pass value.  The env with the
+// lowest pass runs for one tick, then its pass advances by its stride,
+// so over time each gets CPU in proportion to its tickets.  A waking
+// env's pass is moved up to that of the last env run, so sleeping does
+// not bank CPU time.
+//
+// Earliest deadline first.
+//
+// An environment given a reservation with sys_env_set_reservation is
+// guaranteed 'budget' ticks of CPU in every 'period' ticks.  Among those
+// that have budget left, the one whose period ends first runs.  Each
+// tick charges the running env's budget; once it is spent the env is
+// throttled until its period ends and the next one starts with a full
+// budget.  An env that wakes after its period ended starts a new one
+// from the time it wakes.  Reservations are admitted only while they
+// add up to at most SCHED_EDF_MAXUTIL of one CPU, so that they are met
+// even if they all end up on the same CPU.
+//
+// Queues are served strictly in rank order: the deadline class, bands
+// 0..NENVPRIO-2, then the stride class, then the bottom band.  Envs
+// outside the deadline class run in the time its budgets leave over.
+// Ticketed environments keep their shares against demoted CPU hogs,
+// but do not hold up servers like the file server.  A timer tick
+// preempts the running env as soon as a better ranked queue becomes
+// non-empty.
+//
+// An environment that wakes a receiver with IPC hands the CPU straight
+// to it when it next blocks or yields (sched_handoff).
+//
+// Multiprocessors.
+//
+// Each CPU has its own set of run queues and every runnable env is on
+// those of exactly one CPU, env_cpu, the only one it runs on.  A new
+// env goes to the CPU with the fewest runnable envs.  A CPU about to
+// pick an env first steals one, if another CPU has at least two more
+// runnable envs, or any when it has none of its own.  Putting work on
+// the queues of a halted CPU sends it an IRQ_RESCHED IPI.
+//
+// When no queue has work the CPU halts in the kernel, with its timer
+// in one-shot mode set for the next wakeup, instead of ticking
+// uselessly.  Time for boosts and timers is therefore kept by the TSC,
+// see kclock_ticks().
+#define SCHED_QUANTUM(prio)	(1 << (prio))
+#define SCHED_BOOST_TICKS	100
+
+#define SCHED_EDF_MAXUTIL	900	// In thousandths of a CPU
+
+#define STRIDE1			ENV_MAXTICKETS
+#define SCHED_EDF_RANK		0
+#define SCHED_BAND_RANK(prio)	((prio) < NENVPRIO - 1 ? (prio) + 1 : NENVPRIO + 1)
+#define SCHED_STRIDE_RANK	NENVPRIO
+#define NSCHEDRANK		(NENVPRIO + 2)
+
+struct sched_cpu {
+    struct Env_tailq sc_runq[NSCHEDRANK];
+    unsigned sc_nrunnable;		// Envs on sc_runq, running one included
+    uint64_t sc_stride_pass;		// Pass of the last stride env run
+    bool sc_halted;			// Timer not periodic, see sched_halt()
+};
+
+static struct sched_cpu sched_cpus[NCPU];
+static uint32_t sched_ticks;
+static uint32_t sched_boost_epoch;
+static uint32_t sched_edf_util;		// Sum of admitted reservations
+
+// Context switch statistics, see mon_schedstat().
+uint64_t sched_switches;
+uint64_t sched_cycles;
+
+static int
+sched_rank(struct Env *e)
+{
+    if (e->env_budget)
+        return SCHED_EDF_RANK;
+    if (e->env_tickets)
+        return SCHED_STRIDE_RANK;
+    return SCHED_BAND_RANK(e->env_prio);
+}
+
+// Share of a CPU reserved by e, in thousandths, rounded up.
+static uint32_t
+sched_edf_share(struct Env *e)
+{
+    if (!e->env_budget)
+        return 0;
+    return ((uint64_t) e->env_budget * 1000 + e->env_period - 1) / e->env_period;
+}
+
+// Start e's next period if its current one has ended by 'now'.
+// Returns 1 if it had, in which case e missed its deadline if it
+// still had work to do.
+static bool
+sched_edf_replenish(struct Env *e, uint32_t now)
+{
+    if ((int32_t) (now - e->env_deadline) < 0)
+        return 0;
+    e->env_deadline += e->env_period;
+    if ((int32_t) (now - e->env_deadline) >= 0)
+        e->env_deadline = now + e->env_period;
+    e->env_budget_left = e->env_budget;
+    return 1;
+}
+
+// The deadline env on sc's queue that should run now: the one with the
+// earliest deadline among those with budget left.  This scans the whole
+// deadline queue, so a pick costs O(n) in the envs with reservations.
+// Admission control keeps n small in practice; a heap keyed on deadline
+// would also have to be re-keyed as periods are replenished here.
+static struct Env *
+sched_edf_pick(struct sched_cpu *sc, uint32_t now)
+{
+    struct Env *e, *best = NULL;
+
+    TAILQ_FOREACH(e, &sc->sc_runq[SCHED_EDF_RANK], env_sched_link) {
+        sched_edf_replenish(e, now);
+        if (e->env_budget_left &&
+            (!best || (int32_t) (e->env_deadline - best->env_deadline) < 0))
+            best = e;
+    }
+    return best;
+}
+
+// Is e running on some CPU other than this one?
+static bool
+sched_running_elsewhere(struct Env *e)
+{
+    return e != curenv && cpus[e->env_cpu].cpu_env == e;
+}
+
+static void
+sched_enqueue(struct Env *e)
+{
+    struct sched_cpu *sc = &sched_cpus[e->env_cpu];
+    struct Env *pos;
+
+    sc->sc_nrunnable++;
+    if (e->env_cpu != cpunum() && cpus[e->env_cpu].cpu_status == CPU_HALTED)
+        lapic_ipi(e->env_cpu, IRQ_OFFSET + IRQ_RESCHED);
+
+    if (sched_rank(e) != SCHED_STRIDE_RANK) {
+        TAILQ_INSERT_TAIL(&sc->sc_runq[sched_rank(e)], e, env_sched_link);
+        return;
+    }
+
+    // The stride queue is sorted by pass, FIFO among equal passes.
+    // The insert walks the queue, so it costs O(n) in the ticketed
+    // envs on this CPU; the pick is then just the head.
+    TAILQ_FOREACH(pos, &sc->sc_runq[SCHED_STRIDE_RANK], env_sched_link)
+        if (pos->env_pass > e->env_pass)
+            break;
+    if (pos)
+        TAILQ_INSERT_BEFORE(pos, e, env_sched_link);
+    else
+        TAILQ_INSERT_TAIL(&sc->sc_runq[SCHED_STRIDE_RANK], e, env_sched_link);
+}
+
+static void
+sched_dequeue(struct Env *e)
+{
+    struct sched_cpu *sc = &sched_cpus[e->env_cpu];
+
+    sc->sc_nrunnable--;
+    TAILQ_REMOVE(&sc->sc_runq[sched_rank(e)], e, env_sched_link);
+}
+
+void
+sched_init(void)
+{
+    int c, i;
+
+    for (c = 0; c < NCPU; c++)
+        for (i = 0; i < NSCHEDRANK; i++)
+            TAILQ_INIT(&sched_cpus[c].sc_runq[i]);
+}
+
+// Initialize the scheduling state of a freshly allocated env.
+void
+sched_env_init(struct Env *e)
+{
+    int i, c;
+
+    // Start on the least loaded CPU, looking from the next one round
+    // so that ties spread out.
+    e->env_cpu = cpunum();
+    for (i = 1; i <= ncpu; i++) {
+        c = (cpunum() + i) % ncpu;
+        if (cpus[c].cpu_status != CPU_UNUSED &&
+            sched_cpus[c].sc_nrunnable < sched_cpus[e->env_cpu].sc_nrunnable)
+            e->env_cpu = c;
+    }
+    e->env_prio = 0;
+    e->env_prio_pinned = 0;
+    e->env_ticks = 0;
+    e->env_boost_epoch = sched_boost_epoch;
+    e->env_tickets = 0;
+    e->env_stride = 0;
+    e->env_pass = 0;
+    e->env_budget = 0;
+    e->env_period = 0;
+}
+
+// Apply a priority boost that happened while e was blocked, don't let
+// a ticketed env bank the time it slept, and start a new period for a
+// deadline env that slept through the end of its last one.
+static void
+sched_catch_up(struct Env *e)
+{
+    uint32_t now = kclock_ticks();
+
+    if (e->env_budget && (int32_t) (now - e->env_deadline) >= 0) {
+        e->env_deadline = now + e->env_period;
+        e->env_budget_left = e->env_budget;
+    }
+    if (e->env_boost_epoch != sched_boost_epoch) {
+        e->env_boost_epoch = sched_boost_epoch;
+        if (!e->env_prio_pinned) {
+            e->env_prio = 0;
+            e->env_ticks = 0;
+        }
+    }
+    if (e->env_tickets && e->env_pass < sched_cpus[e->env_cpu].sc_stride_pass)
+        e->env_pass = sched_cpus[e->env_cpu].sc_stride_pass;
+}
+
+// Move a runnable e to the tail of band 'prio'.  A ticketed e is
+// re-sorted by its current pass instead.
+static void
+sched_requeue(struct Env *e, int prio)
+{
+    bool queued = (e->env_status == ENV_RUNNABLE);
+
+    if (queued)
+        sched_dequeue(e);
+    e->env_prio = prio;
+    if (queued)
+        sched_enqueue(e);
+}
+
+// Set e's env_status and keep the run queues in sync with it.
+// Every change of env_status after env_alloc() must go through here.
+void
+sched_set_status(struct Env *e, unsigned status)
+{
+    // A dying env only has env_free() left to go through.
+    if (e->env_status == ENV_DYING && status != ENV_FREE)
+        return;
+    // Only a blocked env waits on the clock, for notifications, on an
+    // endpoint, on a futex or in IPC.  An IPC cut short this way, as by
+    // sys_env_set_status, fails with -E_IPC_NOT_RECV.
+    if (status != ENV_NOT_RUNNABLE) {
+        timer_cancel(e);
+        futex_cancel(e);
+        e->env_notify_mask = 0;
+        if (env_ipc_cancel(e))
+            e->env_tf.tf_regs.reg_eax = -E_IPC_NOT_RECV;
+    }
+    if (e->env_status == ENV_RUNNABLE && status != ENV_RUNNABLE) {
+        sched_dequeue(e);
+    } else if (e->env_status != ENV_RUNNABLE && status == ENV_RUNNABLE) {
+        sched_catch_up(e);
+        sched_enqueue(e);
+    }
+    e->env_status = status;
+    if (status == ENV_FREE) {
+        sched_edf_util -= sched_edf_share(e);
+        e->env_budget = 0;
+    }
+}
+
+// e blocks waiting for a message.  Blocking before the quantum runs
+// out is what interactive environments and servers do, so reward it.
+void
+sched_block(struct Env *e)
+{
+    if (!e->env_tickets && !e->env_prio_pinned && e->env_prio > 0 &&
+        e->env_ticks < SCHED_QUANTUM(e->env_prio))
+        e->env_prio--;
+    e->env_ticks = 0;
+    sched_set_status(e, ENV_NOT_RUNNABLE);
+}
+
+// Pin e to band 'prio', or unpin it if prio is ENV_PRIO_UNPINNED.
+int
+sched_set_priority(struct Env *e, int prio)
+{
+    if (prio == ENV_PRIO_UNPINNED) {
+        e->env_prio_pinned = 0;
+        return 0;
+    }
+    if (prio < 0 || prio >= NENVPRIO)
+        return -E_INVAL;
+    e->env_prio_pinned = 1;
+    e->env_ticks = 0;
+    sched_requeue(e, prio);
+    return 0;
+}
+
+// Move e to the stride class with 'tickets' shares, or back to the
+// bands if tickets is 0.
+int
+sched_set_tickets(struct Env *e, uint32_t tickets)
+{
+    bool queued = (e->env_status == ENV_RUNNABLE);
+
+    if (tickets > STRIDE1)
+        return -E_INVAL;
+    if (queued)
+        sched_dequeue(e);
+    if (tickets && !e->env_tickets)
+        e->env_pass = sched_cpus[e->env_cpu].sc_stride_pass;
+    e->env_tickets = tickets;
+    e->env_stride = tickets ? STRIDE1 / tickets : 0;
+    e->env_ticks = 0;
+    if (queued)
+        sched_enqueue(e);
+    return 0;
+}
+
+// Reserve 'budget' ticks of every 'period' for e under the deadline
+// class, or return it to its old class if budget is 0.
+int
+sched_set_reservation(struct Env *e, uint32_t budget, uint32_t period)
+{
+    bool queued = (e->env_status == ENV_RUNNABLE);
+    uint32_t old = sched_edf_share(e);
+
+    if (budget && (budget > period || period > ENV_MAXPERIOD))
+        return -E_INVAL;
+    if (budget && sched_edf_util - old +
+        ((uint64_t) budget * 1000 + period - 1) / period > SCHED_EDF_MAXUTIL)
+        return -E_INVAL;
+
+    if (queued)
+        sched_dequeue(e);
+    sched_edf_util -= old;
+    e->env_budget = budget;
+    e->env_period = budget ? period : 0;
+    sched_edf_util += sched_edf_share(e);
+    e->env_budget_left = budget;
+    e->env_deadline = kclock_ticks() + e->env_period;
+    e->env_ticks = 0;
+    if (queued)
+        sched_enqueue(e);
+    return 0;
+}
+
+static void
+sched_boost(void)
+{
+    struct Env *e, *next;
+    int c, i;
+
+    sched_boost_epoch++;
+    for (c = 0; c < ncpu; c++) {
+        for (i = 0; i < NSCHEDRANK; i++) {
+            if (i == SCHED_EDF_RANK || i == SCHED_STRIDE_RANK)
+                continue;
+            for (e = TAILQ_FIRST(&sched_cpus[c].sc_runq[i]); e; e = next) {
+                next = TAILQ_NEXT(e, env_sched_link);
+                e->env_boost_epoch = sched_boost_epoch;
+                if (!e->env_prio_pinned) {
+                    e->env_ticks = 0;
+                    if (i > SCHED_BAND_RANK(0))
+                        sched_requeue(e, 0);
+                }
+            }
+        }
+    }
+}
+
+// Move e, which must be runnable and not running, to the run queues
+// of CPU 'cpu'.
+static void
+sched_migrate(struct Env *e, int cpu)
+{
+    sched_dequeue(e);
+    e->env_cpu = cpu;
+    sched_catch_up(e);
+    sched_enqueue(e);
+}
+
+// Steal an env for this CPU if another CPU has at least two more
+// runnable envs than we do, or any that are waiting while we have
+// none.  Take it from the worst ranked queue: CPU hogs gain the most
+// from a CPU of their own.
+static void
+sched_balance(void)
+{
+    struct sched_cpu *sc = &sched_cpus[cpunum()], *busiest = sc;
+    struct Env *e;
+    int i;
+
+    for (i = 0; i < ncpu; i++)
+        if (sched_cpus[i].sc_nrunnable > busiest->sc_nrunnable)
+            busiest = &sched_cpus[i];
+    if (busiest == sc ||
+        busiest->sc_nrunnable < sc->sc_nrunnable + (sc->sc_nrunnable ? 2 : 1))
+        return;
+
+    for (i = NSCHEDRANK - 1; i >= 0; i--)
+        TAILQ_FOREACH(e, &busiest->sc_runq[i], env_sched_link)
+            if (!sched_running_elsewhere(e)) {
+                dprintk("CPU %d steals env[%08x] from CPU %d\n",
+                        cpunum(), e->env_id, e->env_cpu);
+                sched_migrate(e, cpunum());
+                return;
+            }
+}
+
+// Put this CPU's clock back to ticking KCLOCK_HZ times a second.
+static void
+sched_clock_periodic(void)
+{
+    if (lapic)
+        lapic_timer_periodic();
+    else
+        kclock_periodic();
+}
+
+// Interrupt this CPU once, 'ticks' clock ticks from now, or never if
+// ticks is 0.
+static void
+sched_clock_oneshot(unsigned ticks)
+{
+    if (lapic) {
+        if (ticks)
+            lapic_timer_oneshot(ticks);
+        else
+            lapic_timer_stop();
+    } else if (ticks)
+        kclock_oneshot(ticks);
+}
+
+// Ticks until an environment is due to wake up on its own, or 0 if
+// none is waiting on the clock.  That includes throttled deadline envs
+// on this CPU, which can run again when their period ends.
+static unsigned
+sched_next_wakeup(void)
+{
+    struct Env *e;
+    uint32_t now = kclock_ticks();
+    unsigned ticks = timer_next(), left;
+
+    TAILQ_FOREACH(e, &sched_cpus[cpunum()].sc_runq[SCHED_EDF_RANK], env_sched_link) {
+        left = (int32_t) (e->env_deadline - now) > 0 ? e->env_deadline - now : 1;
+        if (!ticks || left < ticks)
+            ticks = left;
+    }
+    return ticks;
+}
+
+// Nothing is runnable here.  Halt until the next wakeup or until
+// another CPU gives us work, or, if nothing is waiting on the clock
+// and no other CPU has anything to run either, every environment is
+// blocked for good and all that is left is the monitor.
+static void __attribute__((noreturn))
+sched_halt(void)
+{
+    unsigned ticks = sched_next_wakeup();
+    int i;
+
+    for (i = 0; i < ncpu; i++)
+        if (i != cpunum() && (cpus[i].cpu_env || sched_cpus[i].sc_nrunnable))
+            break;
+    if (!ticks && i == ncpu) {
+        cprintf("No runnable environments - nothing more to do!\n");
+        while (1)
+            monitor(NULL);
+    }
+
+    // The interrupt that wakes us arrives on this stack and goes to
+    // sched_tick() or sched_yield(), which never return here, so start
+    // from the top.  Leave curenv's page directory, which another CPU
+    // may free while we sleep.
+    sysenter_save();
+    env_acct_leave();
+    curenv = NULL;
+    lcr3(boot_cr3);
+    sched_cpus[cpunum()].sc_halted = 1;
+    sched_clock_oneshot(ticks);
+    xchg(&thiscpu->cpu_status, CPU_HALTED);
+    unlock_kernel();
+    asm volatile("movl %0, %%esp\n"
+                 "\tmovl $0, %%ebp\n"
+                 "\tsti\n"
+                 "1:\thlt\n"
+                 "\tjmp 1b\n"
+                 : : "r" (KSTACKTOP_CPU(cpunum())));
+    panic("halt returned");  /* mostly to placate the compiler */
+}
+
+// Does rank i of sc have an env that may run now?  Throttled deadline
+// envs don't count.
+static bool
+sched_rank_ready(struct sched_cpu *sc, int i, uint32_t now)
+{
+    if (i == SCHED_EDF_RANK)
+        return sched_edf_pick(sc, now) != NULL;
+    return !TAILQ_EMPTY(&sc->sc_runq[i]);
+}
+
+// Called on every timer interrupt.  Charges the tick to the running
+// environment and preempts it if its quantum or budget is used up or
+// a better ranked queue has work.  Returns if curenv should keep
+// running.
+void
+sched_tick(void)
+{
+    struct sched_cpu *sc = &sched_cpus[cpunum()];
+    uint32_t now = kclock_ticks();
+    int i;
+
+    // Every CPU ticks, but the clock moves on only once.
+    if (now > sched_ticks) {
+        if (now / SCHED_BOOST_TICKS != sched_ticks / SCHED_BOOST_TICKS)
+            sched_boost();
+        sched_ticks = now;
+    }
+
+    if (!curenv || curenv->env_status != ENV_RUNNABLE)
+        sched_yield();
+
+    if (curenv->env_budget) {
+        if (curenv->env_budget_left)
+            curenv->env_budget_left--;
+        if (sched_edf_pick(sc, now) != curenv)
+            sched_yield();
+        return;
+    }
+
+    if (curenv->env_tickets) {
+        curenv->env_pass += curenv->env_stride;
+        sched_yield();
+    }
+
+    if (++curenv->env_ticks >= SCHED_QUANTUM(curenv->env_prio)) {
+        curenv->env_ticks = 0;
+        if (!curenv->env_prio_pinned && curenv->env_prio < NENVPRIO - 1)
+            sched_requeue(curenv, curenv->env_prio + 1);
+        sched_yield();
+    }
+
+    for (i = 0; i < sched_rank(curenv); i++)
+        if (sched_rank_ready(sc, i, now))
+            sched_yield();
+}
+
+// Run e now, instead of whatever the run queues would choose, and
+// rotate curenv as if it had yielded.  Falls back to sched_yield()
+// if e is not runnable, is running on another CPU or has spent its
+// deadline budget.  Otherwise e moves to this CPU, next to the env it
+// talks to.
+void
+sched_yield_to(struct Env *e)
+{
+    if (!e || e == curenv || e->env_status != ENV_RUNNABLE ||
+        sched_running_elsewhere(e) || (e->env_budget && !e->env_budget_left))
+        sched_yield();
+
+    if (curenv && curenv->env_status == ENV_RUNNABLE)
+        sched_requeue(curenv, curenv->env_prio);
+    if (e->env_cpu != cpunum())
+        sched_migrate(e, cpunum());
+    dprintk("Hand off to env[%08x]\n", e->env_id);
+    e->env_runs++;
+    sched_switches++;
+    env_run(e);
+}
+
+// curenv gives up the CPU.  If it woke an env with IPC since it last
+// did, run that env next, so that a message is handled as soon as its
+// sender waits for the reply rather than a scheduling round later.
+void
+sched_handoff(void)
+{
+    struct Env *e = NULL;
+
+    if (curenv && curenv->env_ipc_handoff) {
+        envid2env(curenv->env_ipc_handoff, &e, 0);
+        curenv->env_ipc_handoff = 0;
+    }
+    sched_yield_to(e);
+}
+
 // Choose a user environment to run and run it.
 void
 sched_yield(void)
 {
-	// Implement simple round-robin scheduling.
-	// Search through 'envs' for a runnable environment,
-	// in circular fashion starting after the previously running env,
-	// and switch to the first such environment found.
+	// Run the head of the best ranked non-empty queue.
 	// It's OK to choose the previously running env if no other env
 	// is runnable.
-	// But never choose envs[0], the idle environment,
-	// unless NOTHING else is runnable.
-
-	// LAB 4: Your code here.
+    struct sched_cpu *sc = &sched_cpus[cpunum()];
     struct Env *e;
+    uint64_t start = read_tsc();
+    uint32_t now = kclock_ticks();
+    int i;
 
-    if (curenv == NULL)
-        curenv = &envs[0];
-    
-    for (e = curenv + 1; e < &envs[NENV]; e++) {
-        if (e->env_status == ENV_RUNNABLE) {
-            dprintk("Now switch to env[%08x]\n", e->env_id);
-            env_run(e);
-            return;
-        }
+    if (sc->sc_halted) {
+        sc->sc_halted = 0;
+        sched_clock_periodic();
     }
+    if (curenv && curenv->env_status == ENV_RUNNABLE)
+        sched_requeue(curenv, curenv->env_prio);
+    sched_balance();
 
-    for (e = &envs[1]; e <= curenv; e++) {
-        if (e->env_status == ENV_RUNNABLE) {
-            dprintk("Now switch to env[%08x]\n", e->env_id);
+    for (i = 0; i < NSCHEDRANK; i++) {
+        if (i == SCHED_EDF_RANK)
+            e = sched_edf_pick(sc, now);
+        else
+            e = TAILQ_FIRST(&sc->sc_runq[i]);
+        if (e != NULL) {
+            dprintk("CPU %d switch to env[%08x]\n", cpunum(), e->env_id);
+            if (i == SCHED_STRIDE_RANK)
+                sc->sc_stride_pass = e->env_pass;
+            e->env_runs++;
+            sched_switches++;
+            sched_cycles += read_tsc() - start;
             env_run(e);
-            return;
         }
     }
 
-	// Run the special idle environment when nothing else is runnable.
-	if (envs[0].env_status == ENV_RUNNABLE) {
-        dprintk("Scheduler: have nothing to run but idle\n");
-		env_run(&envs[0]);
-	} else {
-		cprintf("Destroyed all environments - nothing more to do!\n");
-		while (1)
-			monitor(NULL);
-	}
+    sched_halt();
 }
@@ -6,7 +6,25 @@
 # error "This is a JOS kernel header; user programs should not #include it"
 #endif
 
-// This function does not return.
+#include <inc/types.h>
+
+struct Env;
+
+extern uint64_t sched_switches;		// Number of scheduling decisions
+extern uint64_t sched_cycles;		// Cycles spent making them
+
+void sched_init(void);
+void sched_env_init(struct Env *e);
+void sched_set_status(struct Env *e, unsigned status);
+void sched_block(struct Env *e);
+int  sched_set_priority(struct Env *e, int prio);
+int  sched_set_tickets(struct Env *e, uint32_t tickets);
+int  sched_set_reservation(struct Env *e, uint32_t budget, uint32_t period);
+void sched_tick(void);
+
+// These functions do not return.
 void sched_yield(void) __attribute__((noreturn));
+void sched_yield_to(struct Env *e) __attribute__((noreturn));
+void sched_handoff(void) __attribute__((noreturn));
 
 #endif	// !JOS_KERN_SCHED_H
@@ -0,0 +1,146 @@
+// Named shared-memory segments.
+//
+// A segment is a run of zeroed pages registered under a 32-bit key, so
+// that envs which are not related by fork can map the same memory:
+// one creates it with sys_shm_create, and any env that knows the key
+// maps all of it with sys_shm_attach.  The segment table holds one
+// pp_ref on each page and every attachment holds another, so a page is
+// freed once the segment has been destroyed and the last mapping of it
+// is gone.  A segment is destroyed by its owner, when the owner is
+// freed, or when the last attachment is detached, by sys_shm_detach or
+// by the attaching env being freed.  Mappings a child inherits through
+// fork with PTE_SHARE are not attachments.
+
+#include <inc/error.h>
+#include <inc/string.h>
+
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/shm.h>
+
+static struct Shm shms[NSHM];
+static unsigned shm_attached[NSHM][NENV];	// Attachments by env index
+
+// Create segment 'key' of npages zeroed pages, owned by 'owner'.
+// Returns 0 on success, -E_INVAL if the key is taken, -E_NO_MEM if the
+// segment table or memory is exhausted.
+int
+shm_create(struct Env *owner, uint32_t key, unsigned npages)
+{
+    struct Shm *s, *free = NULL;
+    unsigned i;
+
+    for (s = shms; s < shms + NSHM; s++) {
+        if (s->shm_key == key)
+            return -E_INVAL;
+        if (!s->shm_key && !free)
+            free = s;
+    }
+    if (!free)
+        return -E_NO_MEM;
+
+    for (i = 0; i < npages; i++) {
+        if (page_alloc(&free->shm_pages[i]) < 0) {
+            while (i-- > 0)
+                page_decref(free->shm_pages[i]);
+            return -E_NO_MEM;
+        }
+        free->shm_pages[i]->pp_ref++;
+        memset(page2kva(free->shm_pages[i]), 0, PGSIZE);
+    }
+    free->shm_key = key;
+    free->shm_owner = owner->env_id;
+    free->shm_npages = npages;
+    return 0;
+}
+
+// Find segment 'key'.
+// Returns 0 on success, -E_NOT_FOUND if there is none.
+int
+shm_lookup(uint32_t key, struct Shm **shm_store)
+{
+    struct Shm *s;
+
+    for (s = shms; s < shms + NSHM; s++)
+        if (s->shm_key && s->shm_key == key) {
+            *shm_store = s;
+            return 0;
+        }
+    return -E_NOT_FOUND;
+}
+
+// Find the segment whose first page is pp, or NULL.
+struct Shm *
+shm_find_page(struct Page *pp)
+{
+    struct Shm *s;
+
+    for (s = shms; s < shms + NSHM; s++)
+        if (s->shm_key && s->shm_pages[0] == pp)
+            return s;
+    return NULL;
+}
+
+// Remove s from the table and drop its references to its pages.  Envs
+// that have it attached keep their mappings.
+void
+shm_destroy(struct Shm *s)
+{
+    unsigned i;
+
+    for (i = 0; i < s->shm_npages; i++)
+        page_decref(s->shm_pages[i]);
+    s->shm_key = 0;
+    s->shm_owner = 0;
+    s->shm_npages = 0;
+    s->shm_nattach = 0;
+    memset(shm_attached[s - shms], 0, sizeof(shm_attached[0]));
+}
+
+// Count an attachment of s by e.
+void
+shm_attach(struct Shm *s, struct Env *e)
+{
+    s->shm_nattach++;
+    shm_attached[s - shms][ENVX(e->env_id)]++;
+}
+
+// Drop an attachment of s by e, destroying s if it was the last.  Does
+// nothing if e has no attachment left, as when it inherited its
+// mapping through fork.
+void
+shm_detach(struct Shm *s, struct Env *e)
+{
+    unsigned *n = &shm_attached[s - shms][ENVX(e->env_id)];
+
+    if (!*n)
+        return;
+    (*n)--;
+    if (--s->shm_nattach == 0)
+        shm_destroy(s);
+}
+
+// e is being freed: destroy the segments it owns, and drop its
+// attachments to the others.
+void
+shm_env_free(struct Env *e)
+{
+    struct Shm *s;
+    unsigned *n;
+
+    for (s = shms; s < shms + NSHM; s++) {
+        if (!s->shm_key)
+            continue;
+        if (s->shm_owner == e->env_id) {
+            shm_destroy(s);
+            continue;
+        }
+        n = &shm_attached[s - shms][ENVX(e->env_id)];
+        if (!*n)
+            continue;
+        s->shm_nattach -= *n;
+        *n = 0;
+        if (s->shm_nattach == 0)
+            shm_destroy(s);
+    }
+}
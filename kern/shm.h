@@ -0,0 +1,29 @@
+/* See COPYRIGHT for copyright information. */
+
+#ifndef JOS_KERN_SHM_H
+#define JOS_KERN_SHM_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/env.h>
+
+struct Page;
+
+struct Shm {
+	uint32_t shm_key;		// Name, 0 if the slot is free
+	envid_t shm_owner;		// Env that created us
+	unsigned shm_npages;
+	unsigned shm_nattach;		// Attachments not yet detached
+	struct Page *shm_pages[SHM_MAXPAGES];
+};
+
+int  shm_create(struct Env *owner, uint32_t key, unsigned npages);
+int  shm_lookup(uint32_t key, struct Shm **shm_store);
+struct Shm *shm_find_page(struct Page *pp);
+void shm_destroy(struct Shm *s);
+void shm_attach(struct Shm *s, struct Env *e);
+void shm_detach(struct Shm *s, struct Env *e);
+void shm_env_free(struct Env *e);
+
+#endif	// !JOS_KERN_SHM_H
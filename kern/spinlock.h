@@ -0,0 +1,43 @@
+#ifndef JOS_KERN_SPINLOCK_H
+#define JOS_KERN_SPINLOCK_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/types.h>
+
+// Mutual exclusion lock.
+struct spinlock {
+	volatile uint32_t locked;	// Is the lock held?
+	struct Cpu *cpu;		// The CPU holding the lock, for debugging
+	const char *name;		// Name of lock, for debugging
+};
+
+void __spin_initlock(struct spinlock *lk, const char *name);
+void spin_lock(struct spinlock *lk);
+void spin_unlock(struct spinlock *lk);
+
+#define spin_initlock(lock)	__spin_initlock(lock, #lock)
+
+// The big kernel lock.  Every CPU holds it while it runs kernel code,
+// which keeps envs[], the page free list and the scheduler consistent.
+extern struct spinlock kernel_lock;
+
+static inline void
+lock_kernel(void)
+{
+	spin_lock(&kernel_lock);
+}
+
+static inline void
+unlock_kernel(void)
+{
+	spin_unlock(&kernel_lock);
+
+	// Emulators tend to run one CPU at a time for a long stretch.
+	// Without the pause, this CPU is likely to reacquire the lock
+	// before another CPU has even had a chance to try.
+	asm volatile("pause");
+}
+
+#endif
@@ -11,6 +11,11 @@
 #include <kern/syscall.h>
 #include <kern/console.h>
 #include <kern/sched.h>
+#include <kern/spinlock.h>
+#include <kern/timer.h>
+#include <kern/endpoint.h>
+#include <kern/futex.h>
+#include <kern/shm.h>
 #include <kern/kdebug.h>
 
 #if defined(DEBUG_SYSCALL)
@@ -34,20 +39,53 @@ char *syscall_names[] = {
 	"ipc_try_send",
 	"ipc_recv",
     "debug_va_mapping",
+	"env_set_priority",
+	"env_set_tickets",
+	"yield_to",
+	"sleep",
+	"ipc_send",
+	"env_set_reservation",
+	"ipc_sendv",
+	"ipc_recvv",
+	"ipc_call",
+	"ipc_reply_recv",
+	"notify",
+	"wait_notify",
+	"ep_create",
+	"ep_bind",
+	"ep_call",
+	"futex_wait",
+	"futex_wake",
+	"shm_create",
+	"shm_attach",
+	"shm_detach",
+	"shm_destroy",
+	"batch",
+	"page_alloc_range",
+	"page_map_range",
+	"page_unmap_range",
 };
 
+// Mapped read-only for users at USYSSTATS, so it gets pages of its own.
+struct Syscall_stats syscall_stats __attribute__((aligned(PGSIZE)));
+
 // Print a string to the system console.
 // The string is exactly 'len' characters long.
 // Destroys the environment on memory errors.
 static void
 sys_cputs(const char *s, size_t len)
 {
-	// Check that the user has permission to read memory [s, s+len).
-	// Destroy the environment if not.
-    user_mem_assert(curenv, s, len, PTE_U);
-
-	// Print the string supplied by the user.
-	cprintf("%.*s", len, s);
+    char buf[256];
+    size_t n;
+
+	// Copy the string supplied by the user in pieces and print them.
+	// Destroy the environment if it can't read memory [s, s+len).
+    for (; len > 0; s += n, len -= n) {
+        n = MIN(len, sizeof(buf));
+        if (copyin(buf, s, n) < 0)
+            user_mem_fault(curenv, s);
+        cprintf("%.*s", n, buf);
+    }
 }
 
 // Read a character from the system console.
@@ -94,7 +132,141 @@ sys_env_destroy(envid_t envid)
 static void
 sys_yield(void)
 {
-	sched_yield();
+	sched_handoff();
+}
+
+// Deschedule current environment and run envid in its place, if envid
+// is runnable; otherwise this is sys_yield().  Lets a server pass the
+// CPU straight to the client it is working for.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist.
+static int
+sys_yield_to(envid_t envid)
+{
+    struct Env *e;
+    int r;
+
+    if ((r = envid2env(envid, &e, 0)) < 0)
+        return r;
+    curenv->env_ipc_handoff = 0;
+    curenv->env_tf.tf_regs.reg_eax = 0;
+    sched_yield_to(e);
+}
+
+// Block for 'ticks' clock ticks (KCLOCK_HZ a second), or just yield
+// if ticks is 0.  Returns 0.
+static int
+sys_sleep(uint32_t ticks)
+{
+    curenv->env_tf.tf_regs.reg_eax = 0;
+    if (ticks) {
+        sched_block(curenv);
+        timer_set(curenv, ticks);
+    }
+    sched_handoff();
+}
+
+// Set notification 'bits' in envid's pending word, and wake envid if
+// it is waiting in sys_wait_notify for any of them.  Notifications
+// carry no data and do not queue: a bit sent twice before it is taken
+// is taken once.  Never blocks.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist.
+//		(No need to check permissions.)
+static int
+sys_notify(envid_t envid, uint32_t bits)
+{
+    struct Env *e;
+    uint32_t ready;
+    int r;
+
+    if ((r = envid2env(envid, &e, 0)) < 0)
+        return r;
+    e->env_notify_pending |= bits;
+    if ((ready = e->env_notify_pending & e->env_notify_mask) != 0) {
+        e->env_notify_pending &= ~ready;
+        e->env_tf.tf_regs.reg_eax = ready;
+        sched_set_status(e, ENV_RUNNABLE);
+    }
+    return 0;
+}
+
+// Wait until any notification bit in 'mask' is pending, then clear
+// the pending bits in mask and return them.  Returns at once if some
+// already are, or with 0 if mask is 0.
+//
+// This function only returns if it need not block, but the system
+// call always returns the bits taken.
+static uint32_t
+sys_wait_notify(uint32_t mask)
+{
+    uint32_t ready = curenv->env_notify_pending & mask;
+
+    if (ready || !mask) {
+        curenv->env_notify_pending &= ~ready;
+        return ready;
+    }
+    curenv->env_notify_mask = mask;
+    sched_block(curenv);
+    sched_handoff();
+}
+
+// Find the physical address of the user word at va, for a futex.
+// Returns 0 on success, -E_INVAL if va is not aligned to a word or
+// not mapped user-accessible.
+static int
+futex_lookup(void *va, physaddr_t *pa_store)
+{
+    struct Page *pp;
+    pte_t *pte;
+
+    if ((uintptr_t) va % sizeof(uint32_t) != 0 || (uintptr_t) va >= ULIM ||
+        !(pp = page_lookup(curenv->env_pgdir, va, &pte)) ||
+        (*pte & (PTE_P | PTE_U)) != (PTE_P | PTE_U))
+        return -E_INVAL;
+    *pa_store = page2pa(pp) + PGOFF(va);
+    return 0;
+}
+
+// If the word at va still holds 'expected', block until another env
+// calls sys_futex_wake on it, through whatever mapping of the same
+// page.  Wakeups may be spurious, so callers re-check their condition.
+//
+// This function only returns if it need not block, but the system
+// call returns 0 in either case, < 0 on error.  Errors are:
+//	-E_INVAL if va is not word-aligned or not mapped user-accessible.
+static int
+sys_futex_wait(uint32_t *va, uint32_t expected)
+{
+    physaddr_t pa;
+    int r;
+
+    if ((r = futex_lookup(va, &pa)) < 0)
+        return r;
+    // The kernel lock orders this read against sys_futex_wake.
+    if (*va != expected)
+        return 0;
+    curenv->env_tf.tf_regs.reg_eax = 0;
+    sched_block(curenv);
+    futex_wait(curenv, pa);
+    sched_handoff();
+}
+
+// Wake up to n envs blocked in sys_futex_wait on the word at va.
+//
+// Returns the number woken, < 0 on error.  Errors are:
+//	-E_INVAL if va is not word-aligned or not mapped user-accessible.
+static int
+sys_futex_wake(uint32_t *va, int n)
+{
+    physaddr_t pa;
+    int r;
+
+    if ((r = futex_lookup(va, &pa)) < 0)
+        return r;
+    return futex_wake(pa, n);
 }
 
 // Allocate a new environment.
@@ -116,15 +288,19 @@ sys_exofork(void)
         panic("sys_exofork: no more env available.");
     }
 
+    sysenter_save();
     e->env_tf = curenv->env_tf;
     e->env_tf.tf_regs.reg_eax = 0;
-    e->env_status = ENV_NOT_RUNNABLE;
+    sched_set_status(e, ENV_NOT_RUNNABLE);
 
     return e->env_id;
 }
 
 // Set envid's env_status to status, which must be ENV_RUNNABLE
-// or ENV_NOT_RUNNABLE.
+// or ENV_NOT_RUNNABLE.  Making an env blocked in IPC runnable cancels
+// its IPC, whose system call then fails with -E_IPC_NOT_RECV.
+// Suspending a sleeping env cancels its wakeup, so that it stays
+// suspended until made runnable again.
 //
 // Returns 0 on success, < 0 on error.  Errors are:
 //	-E_BAD_ENV if environment envid doesn't currently exist,
@@ -149,10 +325,72 @@ sys_env_set_status(envid_t envid, int status)
     if ((status != ENV_RUNNABLE) && (status != ENV_NOT_RUNNABLE))
         return -E_INVAL;
 
-    e->env_status = ENV_RUNNABLE;
+    // sched_set_status keeps the timer of an env that blocks.
+    if (status == ENV_NOT_RUNNABLE)
+        timer_cancel(e);
+    sched_set_status(e, status);
     return 0;
 }
 
+// Pin envid to scheduling band 'prio' (0 is the highest, see
+// kern/sched.c), or let the scheduler move it between bands again
+// if prio is ENV_PRIO_UNPINNED.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if prio is neither a band nor ENV_PRIO_UNPINNED.
+static int
+sys_env_set_priority(envid_t envid, int prio)
+{
+    struct Env *e;
+    int ret;
+
+    if ((ret = envid2env(envid, &e, 1)))
+        return ret;
+    return sched_set_priority(e, prio);
+}
+
+// Give envid 'tickets' shares of the CPU under the stride scheduler
+// (see kern/sched.c), or return it to the feedback queue if tickets
+// is 0.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if tickets is more than ENV_MAXTICKETS.
+static int
+sys_env_set_tickets(envid_t envid, uint32_t tickets)
+{
+    struct Env *e;
+    int ret;
+
+    if ((ret = envid2env(envid, &e, 1)))
+        return ret;
+    return sched_set_tickets(e, tickets);
+}
+
+// Reserve 'budget' timer ticks of CPU for envid in every 'period' ticks,
+// under the earliest deadline first class (see kern/sched.c), or cancel
+// its reservation if budget is 0.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if budget is more than period, period is more than
+//		ENV_MAXPERIOD, or the reservation does not fit beside the
+//		ones already made.
+static int
+sys_env_set_reservation(envid_t envid, uint32_t budget, uint32_t period)
+{
+    struct Env *e;
+    int ret;
+
+    if ((ret = envid2env(envid, &e, 1)))
+        return ret;
+    return sched_set_reservation(e, budget, period);
+}
+
 // Set envid's trap frame to 'tf'.
 // tf is modified to make sure that user environments always run at code
 // protection level 3 (CPL 3) with interrupts enabled.
@@ -160,18 +398,22 @@ sys_env_set_status(envid_t envid, int status)
 // Returns 0 on success, < 0 on error.  Errors are:
 //	-E_BAD_ENV if environment envid doesn't currently exist,
 //		or the caller doesn't have permission to change envid.
+//	-E_FAULT if tf is not readable.
 static int
 sys_env_set_trapframe(envid_t envid, struct Trapframe *tf)
 {
 	// LAB 4: Your code here.
 	// Remember to check whether the user has supplied us with a good
 	// address!
+    struct Trapframe t;
     struct Env *e;
     int ret;
 
     if ((ret = envid2env(envid, &e, 1)))
         return ret;
-    e->env_tf = *tf;
+    if ((ret = copyin(&t, tf, sizeof(t))) < 0)
+        return ret;
+    e->env_tf = t;
     e->env_tf.tf_cs = GD_UT | 3;
     e->env_tf.tf_ds = GD_UD | 3;
     e->env_tf.tf_es = GD_UD | 3;
@@ -257,7 +499,6 @@ sys_page_alloc(envid_t envid, void *va, int perm)
     ret = page_insert(e->env_pgdir, pp, va, perm);
     /* dump_va_mapping(e->env_pgdir, vaddr); */
     /* dprintk("[DONE]: Insert a page at va 0x%08x.\n", va); */
-    tlbflush();
     return ret;
 }
 
@@ -327,7 +568,6 @@ sys_page_map(envid_t srcenvid, void *srcva,
     }
 
     ret = page_insert(edst->env_pgdir, pp, dstva, perm);
-    tlbflush();
     return ret;
 }
 
@@ -358,7 +598,444 @@ sys_page_unmap(envid_t envid, void *va)
     }
 
     page_remove(e->env_pgdir, va);
-    tlbflush();
+    return 0;
+}
+
+// Check that [va, va+len) is a page-aligned range below UTOP.
+static int
+check_range(void *va, size_t len)
+{
+    uintptr_t vaddr = (uintptr_t) va;
+
+    if (vaddr % PGSIZE != 0 || len % PGSIZE != 0 ||
+        vaddr >= UTOP || len > UTOP - vaddr)
+        return -E_INVAL;
+    return 0;
+}
+
+// Like sys_page_alloc, for every page of [va, va+len), in one call.
+// Either every page is allocated or, on error, none is.
+//
+// Return 0 on success, < 0 on error.  Errors are as for
+// sys_page_alloc, and:
+//	-E_INVAL if len is not page-aligned or va+len is above UTOP.
+//	-E_NO_MEM if there is not enough memory for the whole range.
+static int
+sys_page_alloc_range(envid_t envid, void *va, size_t len, int perm)
+{
+    struct Env *e;
+    int ret;
+
+    if (!(perm & PTE_P) || !(perm & PTE_U) ||
+        (perm & (PTE_PWT | PTE_PCD | PTE_A | PTE_D | PTE_PS | PTE_MBZ)))
+        return -E_INVAL;
+    if ((ret = check_range(va, len)) < 0)
+        return ret;
+    if ((ret = envid2env(envid, &e, 1)))
+        return ret;
+    return page_alloc_range(e->env_pgdir, (uintptr_t) va, len, perm);
+}
+
+// Like sys_page_map, for every page of [srcva, srcva+len) in one call.
+// There are not enough argument registers for both len and perm, so
+// they share one: len is page-aligned, and perm goes in its low bits,
+// as in a PTE.  Mapping a range onto itself changes its permissions.
+// Either every page is mapped or, on error, none is.
+//
+// Return 0 on success, < 0 on error.  Errors are as for sys_page_map,
+// and:
+//	-E_INVAL if either range goes above UTOP, or they are in the same
+//		env and overlap without being the same.
+//	-E_INVAL if any page of the source range is not mapped, or
+//		(perm & PTE_W) but it is read-only.
+static int
+sys_page_map_range(envid_t srcenvid, void *srcva,
+                   envid_t dstenvid, void *dstva, uint32_t len_perm)
+{
+    size_t len = ROUNDDOWN(len_perm, PGSIZE);
+    int perm = PGOFF(len_perm);
+    struct Env *esrc, *edst;
+    int ret;
+
+    if (!(perm & PTE_P) || !(perm & PTE_U) ||
+        (perm & (PTE_PWT | PTE_PCD | PTE_A | PTE_D | PTE_PS | PTE_MBZ)))
+        return -E_INVAL;
+    if ((ret = check_range(srcva, len)) < 0 ||
+        (ret = check_range(dstva, len)) < 0)
+        return ret;
+    if ((ret = envid2env(srcenvid, &esrc, 1)))
+        return ret;
+    if ((ret = envid2env(dstenvid, &edst, 1)))
+        return ret;
+    if (esrc == edst && srcva != dstva &&
+        (uintptr_t) srcva < (uintptr_t) dstva + len &&
+        (uintptr_t) dstva < (uintptr_t) srcva + len)
+        return -E_INVAL;
+    return page_map_range(esrc->env_pgdir, (uintptr_t) srcva,
+                          edst->env_pgdir, (uintptr_t) dstva, len, perm);
+}
+
+// Like sys_page_unmap, for every page of [va, va+len) in one call.
+//
+// Return 0 on success, < 0 on error.  Errors are as for
+// sys_page_unmap, and:
+//	-E_INVAL if len is not page-aligned or va+len is above UTOP.
+static int
+sys_page_unmap_range(envid_t envid, void *va, size_t len)
+{
+    struct Env *e;
+    int ret;
+
+    if ((ret = check_range(va, len)) < 0)
+        return ret;
+    if ((ret = envid2env(envid, &e, 1)))
+        return ret;
+    page_remove_range(e->env_pgdir, (uintptr_t) va, len);
+    return 0;
+}
+
+// Run the n system calls in ops[] in order, in one kernel entry,
+// stopping at the first that fails, and store each one's result in
+// its sb_ret.  Only SYS_page_alloc, SYS_page_map, SYS_page_unmap and
+// SYS_env_set_status can be batched.
+//
+// Returns the number of entries that succeeded; if that is less than
+// n, the failing entry's sb_ret holds the error.  Returns < 0 if the
+// batch itself is bad:
+//	-E_INVAL if n is greater than SYSBATCH_MAX.
+//	-E_FAULT if an entry is not readable, or its sb_ret is not
+//		writable once it has run, say because of an earlier entry.
+static int
+sys_batch(struct Sysbatch *ops, unsigned n)
+{
+    struct Sysbatch op;
+    unsigned i;
+    int r;
+
+    if (n > SYSBATCH_MAX)
+        return -E_INVAL;
+    for (i = 0; i < n; i++) {
+        // Copy in and out every time: an entry may unmap or
+        // write-protect ops[].
+        if (copyin(&op, &ops[i], sizeof(op)) < 0)
+            goto fault;
+        switch (op.sb_num) {
+        case SYS_page_alloc:
+            r = sys_page_alloc(op.sb_args[0], (void *) op.sb_args[1],
+                               op.sb_args[2]);
+            break;
+        case SYS_page_map:
+            r = sys_page_map(op.sb_args[0], (void *) op.sb_args[1],
+                             op.sb_args[2], (void *) op.sb_args[3],
+                             op.sb_args[4]);
+            break;
+        case SYS_page_unmap:
+            r = sys_page_unmap(op.sb_args[0], (void *) op.sb_args[1]);
+            break;
+        case SYS_env_set_status:
+            r = sys_env_set_status(op.sb_args[0], op.sb_args[1]);
+            break;
+        default:
+            r = -E_INVAL;
+            break;
+        }
+        if (copyout(&ops[i].sb_ret, &r, sizeof(r)) < 0)
+            goto fault;
+        if (r < 0)
+            break;
+    }
+    return i;
+
+fault:
+    return -E_FAULT;
+}
+
+// Create a shared-memory segment of npages zeroed pages named 'key'.
+// The caller owns it: it lives until the caller destroys it or is
+// freed, or until the last env to attach it detaches.  Creating a
+// segment does not attach it.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if key is 0 or already names a segment, or npages is 0
+//		or greater than SHM_MAXPAGES.
+//	-E_NO_MEM if there's no memory or no free segment.
+static int
+sys_shm_create(uint32_t key, unsigned npages)
+{
+    if (!key || !npages || npages > SHM_MAXPAGES)
+        return -E_INVAL;
+    return shm_create(curenv, key, npages);
+}
+
+// Map all of segment 'key' at consecutive pages from va in the
+// caller, with permissions perm as in sys_page_map.  Add PTE_SHARE to
+// keep it shared across fork and spawn.  Either every page is mapped
+// or, on error, none is.
+//
+// Returns the number of pages mapped on success, < 0 on error.
+// Errors are:
+//	-E_NOT_FOUND if no segment is named key.
+//	-E_INVAL if va is not page-aligned, the segment does not fit
+//		below UTOP, or perm is inappropriate.
+//	-E_NO_MEM if there's no memory for page tables.
+static int
+sys_shm_attach(uint32_t key, void *va, int perm)
+{
+    uint8_t *dstva = va;
+    struct Shm *s;
+    unsigned i;
+    int r;
+
+    if ((r = shm_lookup(key, &s)) < 0)
+        return r;
+    if ((uintptr_t) va % PGSIZE != 0 || (uintptr_t) va >= UTOP ||
+        s->shm_npages > (UTOP - (uintptr_t) va) / PGSIZE)
+        return -E_INVAL;
+    if (!(perm & PTE_P) || !(perm & PTE_U) ||
+        (perm & (PTE_PWT | PTE_PCD | PTE_A | PTE_D | PTE_PS | PTE_MBZ)))
+        return -E_INVAL;
+    // Allocate the page tables first, so nothing below can fail.
+    for (i = 0; i < s->shm_npages; i++)
+        if (!pgdir_walk(curenv->env_pgdir, dstva + i * PGSIZE, 1))
+            return -E_NO_MEM;
+    for (i = 0; i < s->shm_npages; i++)
+        page_insert(curenv->env_pgdir, s->shm_pages[i],
+                    dstva + i * PGSIZE, perm);
+    shm_attach(s, curenv);
+    return s->shm_npages;
+}
+
+// Unmap the segment attached at va in the caller.  Pages from va on
+// that are not the segment's, because the caller has since remapped
+// them, are left alone.  If this was the last attachment of the
+// segment, it is destroyed and its pages freed.  A mapping inherited
+// through fork is unmapped but was never an attachment.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if no segment is attached at va.
+static int
+sys_shm_detach(void *va)
+{
+    uint8_t *dstva = va;
+    struct Page *pp;
+    struct Shm *s;
+    unsigned i;
+
+    if ((uintptr_t) va % PGSIZE != 0 || (uintptr_t) va >= UTOP ||
+        !(pp = page_lookup(curenv->env_pgdir, va, 0)) ||
+        !(s = shm_find_page(pp)))
+        return -E_INVAL;
+    for (i = 0; i < s->shm_npages; i++)
+        if (page_lookup(curenv->env_pgdir, dstva + i * PGSIZE, 0)
+            == s->shm_pages[i])
+            page_remove(curenv->env_pgdir, dstva + i * PGSIZE);
+    shm_detach(s, curenv);
+    return 0;
+}
+
+// Destroy segment 'key', which the caller must own.  Envs that have
+// it attached keep their mappings, and its pages are freed once the
+// last of them is unmapped.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_NOT_FOUND if no segment is named key.
+//	-E_BAD_ENV if the caller does not own it.
+static int
+sys_shm_destroy(uint32_t key)
+{
+    struct Shm *s;
+    int r;
+
+    if ((r = shm_lookup(key, &s)) < 0)
+        return r;
+    if (s->shm_owner != curenv->env_id)
+        return -E_BAD_ENV;
+    shm_destroy(s);
+    return 0;
+}
+
+// Pass message m from src to e, which is receiving, and mark e no
+// longer receiving.  Leaves e's env_status alone.
+// The first min(m->im_npages, e->env_ipc_maxpages) pages of m are
+// mapped at consecutive pages from e's env_ipc_dstva, or moved there
+// if m has IPC_DONATE.  Either all of them are or, on error, none.
+// Returns the number of pages mapped on success, and < 0 on error,
+// see sys_ipc_try_send.
+static int
+ipc_deliver(struct Env *src, struct Env *e, const struct Ipc_msg *m)
+{
+    unsigned npages = MIN(m->im_npages, e->env_ipc_maxpages);
+    unsigned perm = m->im_perm;
+    uint8_t *dstva = e->env_ipc_dstva;
+    pte_t *srcpte;
+    unsigned i, j;
+
+    if (npages) {
+        if (!(perm & PTE_P) || !(perm & PTE_U) ||
+            (perm & (PTE_PWT | PTE_PCD | PTE_A | PTE_D | PTE_PS | PTE_MBZ)))
+            return -E_INVAL;
+        for (i = 0; i < npages; i++) {
+            if ((uintptr_t) m->im_pages[i] >= UTOP ||
+                (uintptr_t) m->im_pages[i] % PGSIZE != 0)
+                return -E_INVAL;
+            if (!page_lookup(src->env_pgdir, m->im_pages[i], &srcpte) ||
+                !(*srcpte & PTE_P)) {
+                dprintk("ipc_deliver: 0x%08x is not mapped in src env.\n",
+                        m->im_pages[i]);
+                return -E_INVAL;
+            }
+            if ((perm & PTE_W) && !(*srcpte & PTE_W))
+                return -E_INVAL;
+            // A page can only be moved away once.
+            if (m->im_flags & IPC_DONATE)
+                for (j = 0; j < i; j++)
+                    if (m->im_pages[j] == m->im_pages[i])
+                        return -E_INVAL;
+        }
+        // Allocate the page tables first, so nothing below can fail.
+        for (i = 0; i < npages; i++)
+            if (!pgdir_walk(e->env_pgdir, dstva + i * PGSIZE, 1))
+                return -E_NO_MEM;
+        for (i = 0; i < npages; i++) {
+            if (m->im_flags & IPC_DONATE)
+                page_move(src->env_pgdir, m->im_pages[i],
+                          e->env_pgdir, dstva + i * PGSIZE, perm);
+            else
+                page_insert(e->env_pgdir,
+                            page_lookup(src->env_pgdir, m->im_pages[i], 0),
+                            dstva + i * PGSIZE, perm);
+        }
+    }
+    e->env_ipc_perm = npages ? perm : 0;
+    e->env_ipc_npages = npages;
+    e->env_ipc_recving = 0;
+    if (e->env_ipc_recv_from) {
+        TAILQ_REMOVE(&envs[ENVX(e->env_ipc_recv_from)].env_ipc_callers,
+                     e, env_ipc_reply_link);
+        e->env_ipc_recv_from = 0;
+    }
+    e->env_ipc_from = src->env_id;
+    memmove(e->env_ipc_regs, m->im_regs, sizeof(e->env_ipc_regs));
+    e->env_ipc_value = m->im_regs[0];
+
+    return npages;
+}
+
+// A message of one value and, if srcva < UTOP, the page at srcva.
+static void
+ipc_msg_init(struct Ipc_msg *m, uint32_t value, void *srcva, unsigned perm)
+{
+    memset(m, 0, sizeof(*m));
+    m->im_regs[0] = value;
+    m->im_npages = (uintptr_t) srcva < UTOP;
+    m->im_pages[0] = srcva;
+    m->im_perm = perm;
+}
+
+// Send message m to envid if it is receiving, and from us.
+// Returns like sys_ipc_try_send.
+static int
+ipc_try_send(envid_t envid, const struct Ipc_msg *m)
+{
+    struct Env *e;
+    int r;
+
+    if ((r = envid2env(envid, &e, 0)) < 0) {
+        return r;
+    }
+
+    if (!e->env_ipc_recving ||
+        (e->env_ipc_recv_from && e->env_ipc_recv_from != curenv->env_id)) {
+        return -E_IPC_NOT_RECV;
+    }
+
+    if ((r = ipc_deliver(curenv, e, m)) < 0)
+        return r;
+    sched_set_status(e, ENV_RUNNABLE);
+    e->env_tf.tf_regs.reg_eax = 0;
+    curenv->env_ipc_handoff = e->env_id;
+
+    return r;
+}
+
+// Queue curenv to send m to e when e next receives, and wait.
+static void __attribute__((noreturn))
+ipc_send_block(struct Env *e, const struct Ipc_msg *m)
+{
+    curenv->env_ipc_sendto = e->env_id;
+    curenv->env_ipc_send_msg = *m;
+    TAILQ_INSERT_TAIL(&e->env_ipc_senders, curenv, env_ipc_link);
+    sched_block(curenv);
+    // Let the receiver get to its sys_ipc_recv.
+    sched_yield_to(e);
+}
+
+// Send message m to envid, blocking until it is received.
+// Returns like sys_ipc_send.
+static int
+ipc_send(envid_t envid, const struct Ipc_msg *m)
+{
+    struct Env *e;
+    int r;
+
+    if ((r = ipc_try_send(envid, m)) != -E_IPC_NOT_RECV)
+        return r;
+    envid2env(envid, &e, 0);
+    if (e == curenv)
+        return -E_INVAL;
+    ipc_send_block(e, m);
+}
+
+// Have s, which has called e, wait for e's reply.  env_free() fails
+// the calls still waiting when e goes away.
+static void
+ipc_await_reply(struct Env *s, struct Env *e)
+{
+    s->env_ipc_recving = 1;
+    s->env_ipc_recv_from = e->env_id;
+    TAILQ_INSERT_TAIL(&e->env_ipc_callers, s, env_ipc_reply_link);
+}
+
+// Take the message of s, which is blocked sending or calling, for
+// curenv, which is receiving.  s gets the result, or goes on to wait
+// for curenv's reply if it is calling.
+// Returns 1 if curenv got the message, 0 if it was bad.
+static bool
+ipc_take(struct Env *s)
+{
+    int r;
+
+    r = ipc_deliver(s, curenv, &s->env_ipc_send_msg);
+    if (s->env_ipc_calling && r >= 0)
+        ipc_await_reply(s, curenv);
+    else {
+        s->env_tf.tf_regs.reg_eax = r;
+        sched_set_status(s, ENV_RUNNABLE);
+    }
+    s->env_ipc_calling = 0;
+    return !curenv->env_ipc_recving;
+}
+
+// Record where curenv will take the pages of the next message it
+// receives: up to npages of them from dstva, or none if dstva is
+// not below UTOP.
+// Returns 0 on success, -E_INVAL if dstva < UTOP but dstva is not
+// page-aligned, the npages pages from it do not fit below UTOP, or
+// npages is more than IPC_MAXPAGES.
+static int
+ipc_recv_setup(void *dstva, unsigned npages)
+{
+    uintptr_t dstvaddr = (uintptr_t) dstva;
+
+    curenv->env_ipc_dstva = (void *) -1;
+    curenv->env_ipc_maxpages = 0;
+    if (dstvaddr < UTOP) {
+        if (dstvaddr % PGSIZE != 0 || npages > IPC_MAXPAGES ||
+            npages > (UTOP - dstvaddr) / PGSIZE)
+            return -E_INVAL;
+        curenv->env_ipc_dstva = dstva;
+        curenv->env_ipc_maxpages = npages;
+    }
     return 0;
 }
 
@@ -400,82 +1077,274 @@ static int
 sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 {
 	// LAB 4: Your code here.
-    struct Env *e;
-    uintptr_t srcvaddr;
-    struct Page *srcpp, *dstpp;
-    pte_t *srcpte, *dstpte;
-    int r;
+    struct Ipc_msg m;
 
-    if ((r = envid2env(envid, &e, 0)) < 0) {
-        return r;
-    }
+    ipc_msg_init(&m, value, srcva, perm);
+    return ipc_try_send(envid, &m);
+}
 
-    if (!e->env_ipc_recving) {
-        return -E_IPC_NOT_RECV;
-    }
+// Send like sys_ipc_try_send, but if envid is not receiving, block
+// until it is.  Blocked senders queue on the receiver's
+// env_ipc_senders, and each sys_ipc_recv takes the one that has been
+// waiting longest.  The page to send is looked up when the message is
+// taken, not now.
+//
+// Returns like sys_ipc_try_send, and also:
+//	-E_BAD_ENV if envid is destroyed while we wait.
+//	-E_INVAL if envid is the caller, who would wait forever.
+static int
+sys_ipc_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
+{
+    struct Ipc_msg m;
 
-    srcvaddr = (uintptr_t) srcva;
-    if (srcvaddr < UTOP && (uintptr_t) e->env_ipc_dstva < UTOP) {
-        if (srcvaddr % PGSIZE != 0)
-            return -E_INVAL;
-        if (!(perm & PTE_P) || !(perm & PTE_U) ||
-            (perm & (PTE_PWT | PTE_PCD | PTE_A | PTE_D | PTE_PS | PTE_MBZ)))
-            return -E_INVAL;
-        if (user_mem_check(curenv, srcva, PGSIZE, PTE_P|PTE_U))
-            return -E_INVAL;
-        /* TODO: what if the receiver don't assume a page transfer? */
-        /* dprintk("[IPC] [%08x]<%08x> mapping to [%08x]<%08x>\n", */
-        /*         curenv->env_id, srcva, envid, e->env_ipc_dstva); */
-        if ((srcpp = page_lookup(curenv->env_pgdir, srcva, &srcpte)) == 0) {
-            dprintk("sys_ipc_try_send: 0x%08x is not mapped in src env.\n", srcva);
-            return -E_INVAL;
-        }
-        page_insert(e->env_pgdir, srcpp, e->env_ipc_dstva, perm);
-        /* dump_va_mapping(e->env_pgdir, (uintptr_t) e->env_ipc_dstva); */
-        e->env_ipc_perm = perm;
-    } else {
-        e->env_ipc_perm = 0;
-    }
-    /* dprintk("[IPC] [%08x] send %d to [%08x]\n", curenv->env_id, value, envid); */
-    e->env_ipc_recving = 0;
-    e->env_ipc_from = curenv->env_id;
-    e->env_ipc_value = value;
-    e->env_status = ENV_RUNNABLE;
-    e->env_tf.tf_regs.reg_eax = 0;
+    ipc_msg_init(&m, value, srcva, perm);
+    return ipc_send(envid, &m);
+}
 
-    return (e->env_ipc_perm != 0);
+// Send the message at 'msg' to envid, blocking like sys_ipc_send: its
+// IPC_NREGS message registers and up to IPC_MAXPAGES pages, all mapped
+// with permissions msg->im_perm.  The receiver's env_ipc_regs get the
+// registers and env_ipc_npages the number of pages it took, which is
+// fewer than were sent if it asked for fewer.  With IPC_DONATE in
+// msg->im_flags, the pages it takes are moved rather than shared and
+// are no longer mapped in the caller afterwards.
+//
+// Returns the number of pages transferred on success, < 0 on error.
+// Errors are those of sys_ipc_send, and also:
+//	-E_INVAL if msg->im_npages is more than IPC_MAXPAGES, or the
+//		message donates the same page twice.
+// Destroys the environment if msg is not readable.
+static int
+sys_ipc_sendv(envid_t envid, const struct Ipc_msg *msg)
+{
+    struct Ipc_msg m;
+
+    if (copyin(&m, msg, sizeof(m)) < 0)
+        user_mem_fault(curenv, msg);
+    if (m.im_npages > IPC_MAXPAGES)
+        return -E_INVAL;
+    return ipc_send(envid, &m);
 }
 
 // Block until a value is ready.  Record that you want to receive
 // using the env_ipc_recving and env_ipc_dstva fields of struct Env,
 // mark yourself not runnable, and then give up the CPU.
 //
-// If 'dstva' is < UTOP, then you are willing to receive a page of data.
-// 'dstva' is the virtual address at which the sent page should be mapped.
+// If 'dstva' is < UTOP, then you are willing to receive up to 'npages'
+// pages of data, mapped at consecutive pages from 'dstva'.
+//
+// If an env is blocked in sys_ipc_send to us, take its message
+// instead and return at once.
+//
+// If 'timeout' is not 0, give up after that many clock ticks.
 //
 // This function only returns on error, but the system call will eventually
 // return 0 on success.
 // Return < 0 on error.  Errors are:
-//	-E_INVAL if dstva < UTOP but dstva is not page-aligned.
+//	-E_INVAL if dstva < UTOP but dstva is not page-aligned, or the
+//		npages pages from it do not fit below UTOP, or npages is
+//		more than IPC_MAXPAGES.
+//	-E_TIMEOUT if nothing was received within 'timeout' ticks.
 static int
-sys_ipc_recv(void *dstva)
+sys_ipc_recvv(void *dstva, unsigned npages, uint32_t timeout)
 {
 	// LAB 4: Your code here.
-    uintptr_t dstvaddr = (uintptr_t) dstva;
+    struct Env *s;
+    int r;
     
-    curenv->env_ipc_dstva = (void *) -1;
-    if (dstvaddr < UTOP) {
-        if (dstvaddr % PGSIZE != 0)
-            return -E_INVAL;
-        curenv->env_ipc_dstva = dstva;
-    }
+    if ((r = ipc_recv_setup(dstva, npages)) < 0)
+        return r;
     curenv->env_ipc_recving = 1;
-    curenv->env_status = ENV_NOT_RUNNABLE;
-    sched_yield();
+
+    // A sender whose page was bad gets the error; try the next.
+    while ((s = TAILQ_FIRST(&curenv->env_ipc_senders)) != NULL) {
+        TAILQ_REMOVE(&curenv->env_ipc_senders, s, env_ipc_link);
+        s->env_ipc_sendto = 0;
+        if (ipc_take(s))
+            return 0;
+    }
+    if (curenv->env_ep) {
+        while ((s = TAILQ_FIRST(&curenv->env_ep->ep_senders)) != NULL) {
+            TAILQ_REMOVE(&curenv->env_ep->ep_senders, s, env_ipc_link);
+            s->env_ipc_send_ep = NULL;
+            if (ipc_take(s))
+                return 0;
+        }
+    }
+
+    sched_block(curenv);
+    if (curenv->env_ep)
+        endpoint_wait(curenv);
+    if (timeout)
+        timer_set(curenv, timeout);
+    sched_handoff();
 
 	return 0;
 }
 
+// Receive like sys_ipc_recvv, with room for at most one page.
+static int
+sys_ipc_recv(void *dstva, uint32_t timeout)
+{
+    return sys_ipc_recvv(dstva, 1, timeout);
+}
+
+// Send the message at 'msg' to envid like sys_ipc_sendv, then wait
+// for envid's reply, received like sys_ipc_recvv with 'dstva' and
+// 'npages'.  Messages from other envs wait until our next receive.
+// No other env can slip a message in between, so a server can answer
+// with sys_ipc_try_send, as sys_ipc_reply_recv does.
+//
+// This function only returns on error, but the system call returns 0
+// once the reply arrives.  Return < 0 on error.  Errors are those of
+// sys_ipc_sendv and sys_ipc_recvv, and also:
+//	-E_INVAL if envid is the caller.
+//	-E_BAD_ENV if envid is destroyed before it replies.
+static int
+sys_ipc_call(envid_t envid, const struct Ipc_msg *msg, void *dstva,
+             unsigned npages)
+{
+    struct Ipc_msg m;
+    struct Env *e;
+    int r;
+
+    if (copyin(&m, msg, sizeof(m)) < 0)
+        user_mem_fault(curenv, msg);
+    if (m.im_npages > IPC_MAXPAGES)
+        return -E_INVAL;
+    if ((r = ipc_recv_setup(dstva, npages)) < 0)
+        return r;
+    if ((r = envid2env(envid, &e, 0)) < 0)
+        return r;
+    if (e == curenv)
+        return -E_INVAL;
+
+    r = ipc_try_send(envid, &m);
+    if (r == -E_IPC_NOT_RECV) {
+        // sys_ipc_recvv sets us receiving when it takes the message.
+        curenv->env_ipc_calling = 1;
+        ipc_send_block(e, &m);
+    }
+    if (r < 0)
+        return r;
+    ipc_await_reply(curenv, e);
+    sched_block(curenv);
+    sched_yield_to(e);
+}
+
+// Create endpoint number 'ep' (0 <= ep < NENDPOINT), owned by the
+// caller.  It lives until the caller is freed.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if ep is out of range, or another env has created it.
+static int
+sys_ep_create(int ep)
+{
+    if (ep < 0 || ep >= NENDPOINT)
+        return -E_INVAL;
+    if (endpoints[ep].ep_owner && endpoints[ep].ep_owner != curenv->env_id)
+        return -E_INVAL;
+    endpoints[ep].ep_owner = curenv->env_id;
+    return 0;
+}
+
+// Serve endpoint 'ep' from now on: every receive also takes calls
+// made to ep, or unbind from it if ep is -1.  Only the endpoint's
+// owner and its children may bind to it.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if ep is out of range.
+//	-E_BAD_ENV if ep has not been created, or the caller may not
+//		serve it.
+static int
+sys_ep_bind(int ep)
+{
+    struct Endpoint *p = NULL;
+    int r;
+
+    if (ep != -1) {
+        if ((r = endpoint_lookup(ep, &p)) < 0)
+            return r;
+        if (p->ep_owner != curenv->env_id &&
+            p->ep_owner != curenv->env_parent_id)
+            return -E_BAD_ENV;
+    }
+    curenv->env_ep = p;
+    return 0;
+}
+
+// Call endpoint 'ep': send the message at 'msg' to the worker bound to
+// ep that has waited longest, or, if all are busy, to the first that
+// receives, then wait for that worker's reply like sys_ipc_call.  A
+// call to an endpoint that has not been created yet waits for it, as
+// a send to an env that is not receiving yet does.
+//
+// This function only returns on error, but the system call returns 0
+// once the reply arrives.  Return < 0 on error.  Errors are those of
+// sys_ipc_call, and also:
+//	-E_INVAL if ep is out of range.
+//	-E_BAD_ENV if ep's owner is freed while we wait.
+static int
+sys_ep_call(int ep, const struct Ipc_msg *msg, void *dstva, unsigned npages)
+{
+    struct Endpoint *p;
+    struct Ipc_msg m;
+    struct Env *w;
+    int r;
+
+    if (copyin(&m, msg, sizeof(m)) < 0)
+        user_mem_fault(curenv, msg);
+    if (m.im_npages > IPC_MAXPAGES)
+        return -E_INVAL;
+    if ((r = ipc_recv_setup(dstva, npages)) < 0)
+        return r;
+    if (ep < 0 || ep >= NENDPOINT)
+        return -E_INVAL;
+    p = &endpoints[ep];
+
+    if ((w = TAILQ_FIRST(&p->ep_receivers)) == NULL) {
+        // sys_ipc_recvv sets us receiving when a worker takes it.
+        curenv->env_ipc_send_ep = p;
+        curenv->env_ipc_send_msg = m;
+        curenv->env_ipc_calling = 1;
+        TAILQ_INSERT_TAIL(&p->ep_senders, curenv, env_ipc_link);
+        sched_block(curenv);
+        sched_yield();
+    }
+
+    if ((r = ipc_deliver(curenv, w, &m)) < 0)
+        return r;
+    sched_set_status(w, ENV_RUNNABLE);
+    w->env_tf.tf_regs.reg_eax = 0;
+    ipc_await_reply(curenv, w);
+    sched_block(curenv);
+    sched_yield_to(w);
+}
+
+// Send the reply at 'reply' to envid, if it is waiting for it, then
+// receive the next message like sys_ipc_recvv, all in one system
+// call.  A reply that cannot be delivered is dropped: envid went away
+// or was not waiting.  If reply is null, only receive.
+//
+// Returns like sys_ipc_recvv, and also:
+//	-E_INVAL if reply->im_npages is more than IPC_MAXPAGES.
+// Destroys the environment if reply is not readable.
+static int
+sys_ipc_reply_recv(envid_t envid, const struct Ipc_msg *reply, void *dstva,
+                   unsigned npages, uint32_t timeout)
+{
+    struct Ipc_msg m;
+
+    if (reply) {
+        if (copyin(&m, reply, sizeof(m)) < 0)
+            user_mem_fault(curenv, reply);
+        if (m.im_npages > IPC_MAXPAGES)
+            return -E_INVAL;
+        ipc_try_send(envid, &m);
+    }
+    return sys_ipc_recvv(dstva, npages, timeout);
+}
+
 static int
 sys_dump_env()
 {
@@ -512,14 +1381,13 @@ sys_debug_va_mapping(uintptr_t va)
 }
 
 // Dispatches to the correct kernel function, passing the arguments.
-int32_t
-syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
+static int32_t
+syscall_dispatch(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
 {
 	// Call the function corresponding to the 'syscallno' parameter.
 	// Return any appropriate return value.
     int32_t ret;
     
-    curenv->env_syscalls ++;
     /* dprintk("[SYSCALL] %s, a1 %08x, a2 %08x, a3 %08x, a4 %08x a5 %08x\n", */
     /*         syscall_names[syscallno], a1, a2, a3, a4, a5); */
     /* dump_va_mapping(curenv->env_pgdir, (unsigned) syscall); */
@@ -551,56 +1419,167 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
         return sys_page_map(a1, (void *) a2, a3, (void *) a4, a5);
     case SYS_page_unmap:
         return sys_page_unmap(a1, (void *) a2);
+    case SYS_page_alloc_range:
+        return sys_page_alloc_range(a1, (void *) a2, a3, a4);
+    case SYS_page_map_range:
+        return sys_page_map_range(a1, (void *) a2, a3, (void *) a4, a5);
+    case SYS_page_unmap_range:
+        return sys_page_unmap_range(a1, (void *) a2, a3);
     case SYS_env_set_pgfault_upcall:
         return sys_env_set_pgfault_upcall(a1, (void *) a2);
     case SYS_ipc_recv:
-        return sys_ipc_recv((void *) a1);
+        return sys_ipc_recv((void *) a1, a2);
     case SYS_ipc_try_send:
         return sys_ipc_try_send(a1, a2, (void *) a3, a4);
     case SYS_env_set_trapframe:
         return sys_env_set_trapframe(a1, (struct Trapframe *) a2);
+    case SYS_env_set_priority:
+        return sys_env_set_priority(a1, a2);
+    case SYS_env_set_tickets:
+        return sys_env_set_tickets(a1, a2);
+    case SYS_yield_to:
+        return sys_yield_to(a1);
+    case SYS_sleep:
+        return sys_sleep(a1);
+    case SYS_ipc_send:
+        return sys_ipc_send(a1, a2, (void *) a3, a4);
+    case SYS_env_set_reservation:
+        return sys_env_set_reservation(a1, a2, a3);
+    case SYS_ipc_sendv:
+        return sys_ipc_sendv(a1, (const struct Ipc_msg *) a2);
+    case SYS_ipc_recvv:
+        return sys_ipc_recvv((void *) a1, a2, a3);
+    case SYS_ipc_call:
+        return sys_ipc_call(a1, (const struct Ipc_msg *) a2, (void *) a3, a4);
+    case SYS_ipc_reply_recv:
+        return sys_ipc_reply_recv(a1, (const struct Ipc_msg *) a2,
+                                  (void *) a3, a4, a5);
+    case SYS_notify:
+        return sys_notify(a1, a2);
+    case SYS_wait_notify:
+        return sys_wait_notify(a1);
+    case SYS_ep_create:
+        return sys_ep_create(a1);
+    case SYS_ep_bind:
+        return sys_ep_bind(a1);
+    case SYS_ep_call:
+        return sys_ep_call(a1, (const struct Ipc_msg *) a2, (void *) a3, a4);
+    case SYS_futex_wait:
+        return sys_futex_wait((uint32_t *) a1, a2);
+    case SYS_futex_wake:
+        return sys_futex_wake((uint32_t *) a1, a2);
+    case SYS_shm_create:
+        return sys_shm_create(a1, a2);
+    case SYS_shm_attach:
+        return sys_shm_attach(a1, (void *) a2, a3);
+    case SYS_shm_detach:
+        return sys_shm_detach((void *) a1);
+    case SYS_shm_destroy:
+        return sys_shm_destroy(a1);
+    case SYS_batch:
+        return sys_batch((struct Sysbatch *) a1, a2);
     }
     
 	panic("syscall not implemented");
 }
 
+// Histogram bucket of a call that took 'cycles': floor(log2(cycles)).
+static int
+syscall_hist_bucket(uint64_t cycles)
+{
+    int b = 0;
+
+    while (cycles >>= 1)
+        b++;
+    return MIN(b, NSYSHIST - 1);
+}
+
+// Counts the call in syscall_stats and curenv, then dispatches it,
+// timing the ones that return.
 int32_t
-do_sysenter(struct Trapframe *tf)
+syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
 {
-    struct PushRegs *r = &tf->tf_regs;
+    uint64_t start, cycles;
     int32_t ret;
-    int *a5ptr;
 
-    curenv->env_tf = *tf;
-	curenv->env_tf.tf_ds = GD_UD | 3;
-	curenv->env_tf.tf_es = GD_UD | 3;
-	curenv->env_tf.tf_ss = GD_UD | 3;
-	curenv->env_tf.tf_cs = GD_UT | 3;
-    curenv->env_tf.tf_esp = tf->tf_regs.reg_ebp;
+    curenv->env_syscalls ++;
+    if (syscallno >= NSYSCALLS)
+        return syscall_dispatch(syscallno, a1, a2, a3, a4, a5);
+    curenv->env_syscall_count[syscallno]++;
+    syscall_stats.ss_count[syscallno]++;
+
+    start = read_tsc();
+    ret = syscall_dispatch(syscallno, a1, a2, a3, a4, a5);
+    cycles = read_tsc() - start;
+    syscall_stats.ss_cycles[syscallno] += cycles;
+    syscall_stats.ss_hist[syscallno][syscall_hist_bucket(cycles)]++;
+    return ret;
+}
 
+// Whether system call 'num' takes a fifth argument.  There is no
+// register left for it on the sysenter path, so the user stub passes
+// it on the user stack, and only these calls pay to fetch it.
+static bool
+syscall_has_a5(uint32_t num)
+{
+    return num == SYS_page_map || num == SYS_page_map_range ||
+        num == SYS_ipc_reply_recv;
+}
 
-    a5ptr = (int *) curenv->env_tf.tf_esp;
-    user_mem_assert(curenv, (const void *) a5ptr, 4, PTE_U);
-    /* print_trapframe(&curenv->env_tf); */
-    
-    /* MAGIC_BREAK; */
-    ret = syscall(r->reg_eax, r->reg_edx, r->reg_ecx, r->reg_ebx, r->reg_edi, *a5ptr);
+// The C half of the sysenter path.  The user's registers stay where
+// sysenter_handler left them: the arguments in *f, and %ebx, %esi,
+// %edi and %ebp in the same registers, which the C calling convention
+// makes us preserve.  Only if the syscall switches away instead of
+// returning does sysenter_save copy them into curenv->env_tf.
+// Returns the syscall's result, which sysexit hands back in %eax.
+int32_t
+do_sysenter(struct Sysframe *f)
+{
+    uint32_t a5 = 0;
+    int32_t ret;
 
-    /* Prepare for sysexit  */
-    tf->tf_regs.reg_ecx = tf->tf_regs.reg_ebp;
-    tf->tf_regs.reg_edx = tf->tf_regs.reg_esi;
-    tf->tf_regs.reg_eax = ret;
-    
-    /* MAGIC_BREAK; */
-    asm volatile("movl %0, %%esp\n\t"
-                 "popa\n\t"
-                 "popl %%ds\n\t"
-                 "popl %%es\n\t"
-                 "sti\n\t"
-                 "sysexit\n\t"
-                 :
-                 : "g" (tf)
-                 );
-    return 0;
+    lock_kernel();
+    env_acct_enter();
+    // Another CPU destroyed us while we were running.
+    if (curenv->env_status == ENV_DYING)
+        env_destroy(curenv);
+    thiscpu->cpu_sysframe = f;
+
+    if (syscall_has_a5(f->sf_eax) &&
+        copyin(&a5, (uint32_t *) f->sf_ebp + 1, sizeof(a5)) < 0)
+        user_mem_fault(curenv, (uint32_t *) f->sf_ebp + 1);
+    ret = syscall(f->sf_eax, f->sf_edx, f->sf_ecx, f->sf_ebx, f->sf_edi, a5);
+
+    thiscpu->cpu_sysframe = NULL;
+    env_acct_leave();
+    unlock_kernel();
+    return ret;
 }
 
+// Copy the user state of a sysenter syscall in progress on this CPU
+// into curenv->env_tf, so that the env can be resumed with iret or
+// duplicated.  Called before switching away from curenv.
+// %eax is left alone: a blocking syscall has already put its result
+// there.  The segment registers and eflags are the ones env_alloc or
+// the last trap left, which are the same.
+void
+sysenter_save(void)
+{
+    struct Sysframe *f = thiscpu->cpu_sysframe;
+    struct Trapframe *tf;
+
+    if (!f)
+        return;
+    thiscpu->cpu_sysframe = NULL;
+    if (!curenv)
+        return;
+    tf = &curenv->env_tf;
+    tf->tf_regs.reg_edx = f->sf_edx;
+    tf->tf_regs.reg_ecx = f->sf_ecx;
+    tf->tf_regs.reg_ebx = f->sf_ebx;
+    tf->tf_regs.reg_edi = f->sf_edi;
+    tf->tf_regs.reg_esi = f->sf_esi;
+    tf->tf_regs.reg_ebp = f->sf_ebp;
+    tf->tf_eip = f->sf_esi;
+    tf->tf_esp = f->sf_ebp;
+}
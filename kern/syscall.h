@@ -6,8 +6,25 @@
 
 #include <inc/syscall.h>
 
+// What sysenter_handler (kern/trapentry.S) pushes on entry: the
+// registers as the user stub in lib/syscall.c loads them, lowest
+// address first.  A fifth argument is on the user stack, above the
+// user's saved %ebp.
+struct Sysframe {
+	uint32_t sf_eax;		// System call number
+	uint32_t sf_edx;		// Arguments 1 to 4
+	uint32_t sf_ecx;
+	uint32_t sf_ebx;
+	uint32_t sf_edi;
+	uint32_t sf_esi;		// User eip to return to
+	uint32_t sf_ebp;		// User esp
+};
+
 int32_t syscall(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5);
+int32_t do_sysenter(struct Sysframe *f);
+void sysenter_save(void);
 
 extern char *syscall_names[];
+extern struct Syscall_stats syscall_stats;
 
 #endif /* !JOS_KERN_SYSCALL_H */
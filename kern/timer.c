@@ -0,0 +1,107 @@
+// Timer wheel.
+//
+// Environments waiting on the clock, in sys_sleep or in sys_ipc_recv
+// with a timeout, hang off a hashed wheel of TIMER_SLOTS lists, in the
+// slot of their deadline modulo TIMER_SLOTS.  Arming and cancelling a
+// timer are O(1).  Each clock tick looks only at the slots of the
+// ticks that have passed since the last one, and wakes the envs there
+// whose deadline has come; the others are a turn or more of the wheel
+// away.
+
+#include <inc/error.h>
+
+#include <kern/env.h>
+#include <kern/kclock.h>
+#include <kern/sched.h>
+#include <kern/timer.h>
+
+#define TIMER_SLOTS	64
+
+static struct Env_list timer_wheel[TIMER_SLOTS];
+static uint32_t timer_last;		// Last tick whose slot was looked at
+static unsigned timer_nwaiting;
+
+// Wake e 'ticks' clock ticks from now, which must be at least 1.
+void
+timer_set(struct Env *e, uint32_t ticks)
+{
+    timer_cancel(e);
+    e->env_wakeup = kclock_ticks() + ticks;
+    if (!e->env_wakeup)		// 0 means no timer
+        e->env_wakeup = 1;
+    LIST_INSERT_HEAD(&timer_wheel[e->env_wakeup % TIMER_SLOTS], e, env_timer_link);
+    timer_nwaiting++;
+}
+
+void
+timer_cancel(struct Env *e)
+{
+    if (!e->env_wakeup)
+        return;
+    LIST_REMOVE(e, env_timer_link);
+    e->env_wakeup = 0;
+    timer_nwaiting--;
+}
+
+// e's time is up.  A receive that timed out returns -E_TIMEOUT; a
+// sleep returns 0.
+static void
+timer_expire(struct Env *e)
+{
+    timer_cancel(e);
+    if (e->env_ipc_recving) {
+        e->env_ipc_recving = 0;
+        e->env_tf.tf_regs.reg_eax = -E_TIMEOUT;
+    } else
+        e->env_tf.tf_regs.reg_eax = 0;
+    sched_set_status(e, ENV_RUNNABLE);
+}
+
+// Called on every timer interrupt, on any CPU.
+void
+timer_tick(void)
+{
+    uint32_t now = kclock_ticks(), t;
+    struct Env *e, *next;
+
+    if ((int32_t) (now - timer_last) <= 0)
+        return;
+    if (!timer_nwaiting) {
+        timer_last = now;
+        return;
+    }
+
+    // After a long halt one turn of the wheel covers every slot.
+    t = now - timer_last > TIMER_SLOTS ? now - TIMER_SLOTS : timer_last;
+    while (t != now) {
+        t++;
+        for (e = LIST_FIRST(&timer_wheel[t % TIMER_SLOTS]); e; e = next) {
+            next = LIST_NEXT(e, env_timer_link);
+            if ((int32_t) (e->env_wakeup - now) <= 0)
+                timer_expire(e);
+        }
+    }
+    timer_last = now;
+}
+
+// Ticks until the next timer expires, or 0 if none is set.  This
+// looks at every waiting env, but is only used when a CPU is about to
+// halt.
+unsigned
+timer_next(void)
+{
+    uint32_t now = kclock_ticks();
+    int32_t d, min = 0x7fffffff;
+    struct Env *e;
+    int i;
+
+    if (!timer_nwaiting)
+        return 0;
+    for (i = 0; i < TIMER_SLOTS; i++)
+        LIST_FOREACH(e, &timer_wheel[i], env_timer_link) {
+            d = (int32_t) (e->env_wakeup - now);
+            if (d < min)
+                min = d;
+        }
+    return min < 1 ? 1 : min;
+}
@@ -11,13 +11,16 @@
 #include <kern/sched.h>
 #include <kern/kclock.h>
 #include <kern/picirq.h>
+#include <kern/cpu.h>
+#include <kern/spinlock.h>
+#include <kern/timer.h>
 #include <kern/kdebug.h>
 
-static struct Taskstate ts;
-
 void tf_handler_default(struct Trapframe *);
 void tf_handler_brkpt(struct Trapframe *);
 void irq_handler_clock(struct Trapframe *);
+void irq_handler_resched(struct Trapframe *);
+void irq_handler_error(struct Trapframe *);
 
 /* Interrupt descriptor table.  (Must be built at run time because
  * shifted function addresses can't be represented in relocation records.)
@@ -59,6 +62,10 @@ static const char *trapname(int trapno)
 		return excnames[trapno];
 	if (trapno == T_SYSCALL)
 		return "System call";
+	if (trapno == IRQ_OFFSET + IRQ_RESCHED)
+		return "Reschedule IPI";
+	if (trapno == IRQ_OFFSET + IRQ_TLB)
+		return "TLB shootdown IPI";
 	if (trapno >= IRQ_OFFSET && trapno < IRQ_OFFSET + 16)
 		return "Hardware Interrupt";
 	return "(unknown trap)";
@@ -78,12 +85,20 @@ idt_init(void)
     extern void trap_pgflt();
     extern void trap_brkpt();
     extern void irq_clock();
+    extern void irq_spurious();
+    extern void irq_resched();
+    extern void irq_tlb();
+    extern void irq_error();
 
     SETGATE(idt[0], 0, GD_KT, trap_divide, 3);
     SETGATE(idt[3], 1, GD_KT, trap_brkpt, 3);
     SETGATE(idt[13], 0, GD_KT, trap_gpflt, 0);
     SETGATE(idt[14], 0, GD_KT, trap_pgflt, 0);
     SETGATE(idt[32], 0, GD_KT, irq_clock, 0);
+    SETGATE(idt[IRQ_OFFSET + IRQ_SPURIOUS], 0, GD_KT, irq_spurious, 0);
+    SETGATE(idt[IRQ_OFFSET + IRQ_RESCHED], 0, GD_KT, irq_resched, 0);
+    SETGATE(idt[IRQ_OFFSET + IRQ_TLB], 0, GD_KT, irq_tlb, 0);
+    SETGATE(idt[IRQ_OFFSET + IRQ_ERROR], 0, GD_KT, irq_error, 0);
     SETGATE(idt[48], 1, GD_KT, trap_syscall, 3);
 
     for (i = 0; i < 256; i++) {
@@ -92,19 +107,32 @@ idt_init(void)
     idt_handlers[3] = tf_handler_brkpt;
     idt_handlers[14] = page_fault_handler;
     idt_handlers[32] = irq_handler_clock;
-    
+    idt_handlers[IRQ_OFFSET + IRQ_RESCHED] = irq_handler_resched;
+    idt_handlers[IRQ_OFFSET + IRQ_ERROR] = irq_handler_error;
+
+	trap_init_percpu();
+}
+
+// Initialize and load the per-CPU TSS and IDT
+void
+trap_init_percpu(void)
+{
+	int i = cpunum();
+	struct Taskstate *ts = &thiscpu->cpu_ts;
+
 	// Setup a TSS so that we get the right stack
 	// when we trap to the kernel.
-	ts.ts_esp0 = KSTACKTOP;
-	ts.ts_ss0 = GD_KD;
+	ts->ts_esp0 = KSTACKTOP_CPU(i);
+	ts->ts_ss0 = GD_KD;
 
-	// Initialize the TSS field of the gdt.
-	gdt[GD_TSS >> 3] = SEG16(STS_T32A, (uint32_t) (&ts),
+	// Initialize the TSS slot of the gdt.
+	gdt[(GD_TSS0 >> 3) + i] = SEG16(STS_T32A, (uint32_t) ts,
 					sizeof(struct Taskstate), 0);
-	gdt[GD_TSS >> 3].sd_s = 0;
+	gdt[(GD_TSS0 >> 3) + i].sd_s = 0;
 
-	// Load the TSS
-	ltr(GD_TSS);
+	// Load the TSS selector (like other segment selectors, the
+	// bottom three bits are special; we leave them 0)
+	ltr(GD_TSS0 + (i << 3));
 
 	// Load the IDT
 	asm volatile("lidt idt_pd");
@@ -186,16 +214,45 @@ trap(struct Trapframe *tf)
 {
 	/* cprintf("Incoming TRAP frame(%s) at %p\n", trapname(tf->tf_trapno), tf); */
 
+	// The CPU that sent this holds the big kernel lock and spins
+	// until we have flushed, so answer without taking the lock and
+	// go straight back to whatever was interrupted.
+	if (tf->tf_trapno == IRQ_OFFSET + IRQ_TLB) {
+		tlb_shootdown_ack();
+		lapic_eoi();
+		env_pop_tf(tf);
+	}
+
+	// Re-acquire the big kernel lock if we were halted in
+	// sched_halt()
+	if (xchg(&thiscpu->cpu_status, CPU_STARTED) == CPU_HALTED)
+		lock_kernel();
+
 	if ((tf->tf_cs & 3) == 3) {
 		// Trapped from user mode.
+		// Acquire the big kernel lock before doing any
+		// serious kernel work.
+		lock_kernel();
+		env_acct_enter();
+		assert(curenv);
+
+		// Another CPU destroyed us while we were running.
+		if (curenv->env_status == ENV_DYING)
+			env_destroy(curenv);
+
 		// Copy trap frame (which is currently on the stack)
 		// into 'curenv->env_tf', so that running the environment
 		// will restart at the trap point.
-		assert(curenv);
+		curenv->env_traps++;
 		curenv->env_tf = *tf;
 		// The trapframe on the stack should be ignored from here on.
 		tf = &curenv->env_tf;
-	}
+	} else if (tf->tf_trapno == T_PGFLT)
+		// The kernel faulted.  page_fault_handler() only returns
+		// from this if the fault was in copyin() and friends.
+		page_fault_handler(tf);
+	else
+		env_acct_enter();
 	
 	// Dispatch based on what type of trap occurred
 	trap_dispatch(tf);
@@ -210,26 +267,47 @@ trap(struct Trapframe *tf)
 }
 
 
+// Where to resume if the kernel faults at 'eip', or 0 if it should not.
+static uintptr_t
+extable_lookup(uintptr_t eip)
+{
+    extern const struct Extable __EXTABLE_BEGIN__[], __EXTABLE_END__[];
+    const struct Extable *ex;
+
+    for (ex = __EXTABLE_BEGIN__; ex < __EXTABLE_END__; ex++)
+        if (ex->ex_insn == eip)
+            return ex->ex_fixup;
+    return 0;
+}
+
 void
 page_fault_handler(struct Trapframe *tf)
 {
 	uint32_t fault_va;
+    uintptr_t fixup;
 
 	// Read processor's CR2 register to find the faulting address
 	fault_va = rcr2();
 
-	cprintf("[%08x] user fault va %08x ip %08x\n",
-            curenv->env_id, fault_va, tf->tf_eip);
-    /* print_trapframe(tf); */
-
-	// Handle kernel-mode page faults.
+	// Handle kernel-mode page faults.  Those on user memory in
+	// copyin() and friends resume at their fixup, with the trap
+	// frame still where the fault pushed it.
     if (tf->tf_cs == GD_KT) {
+        if ((fixup = extable_lookup(tf->tf_eip))) {
+            tf->tf_eip = fixup;
+            env_pop_tf(tf);
+        }
         dump_va_mapping(curenv->env_pgdir, fault_va);
         panic("page fault at kernel mode");
     }
 
+	cprintf("[%08x] user fault va %08x ip %08x\n",
+            curenv->env_id, fault_va, tf->tf_eip);
+    /* print_trapframe(tf); */
+
 	// We've already handled kernel-mode exceptions, so if we get here,
 	// the page fault happened in user mode.
+    curenv->env_pgfaults++;
 
 	// Call the environment's page fault upcall, if one exists.  Set up a
 	// page fault stack frame on the user exception stack (below
@@ -321,9 +399,28 @@ tf_handler_brkpt(struct Trapframe *tf)
 void
 irq_handler_clock(struct Trapframe *tf)
 {
-    if (tf->tf_cs == GD_KT) {
+    // The kernel only takes interrupts while halted in sched_halt().
+    if (tf->tf_cs == GD_KT && curenv) {
         panic("Timer interrupt at kernel");
     }
+    lapic_eoi();
+    kinfo.ki_ticks = kclock_ticks();
+    timer_tick();
+    sched_tick();
+}
+
+// Another CPU put work on our run queue while we were halted.
+void
+irq_handler_resched(struct Trapframe *tf)
+{
+    lapic_eoi();
     sched_yield();
 }
 
+void
+irq_handler_error(struct Trapframe *tf)
+{
+    cprintf("CPU %d: local APIC error\n", cpunum());
+    lapic_eoi();
+}
+
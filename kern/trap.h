@@ -12,7 +12,15 @@
 /* The kernel's interrupt descriptor table */
 extern struct Gatedesc idt[];
 
+/* An exception table entry: if the instruction at ex_insn faults,
+ * resume at ex_fixup instead.  See kern/usercopy.S. */
+struct Extable {
+	uintptr_t ex_insn;
+	uintptr_t ex_fixup;
+};
+
 void idt_init(void);
+void trap_init_percpu(void);
 void msr_init(void);
 void print_regs(struct PushRegs *regs);
 void print_trapframe(struct Trapframe *tf);
@@ -0,0 +1,87 @@
+// Queue page-table system calls and submit them together with
+// sys_batch, paying for one kernel entry instead of one per call.
+//
+// The queue has a page of its own at BATCHVA, which fork does not copy
+// to the child.  So a batch can make any other page copy-on-write,
+// while the kernel can still write the results back into the queue.
+
+#include <inc/lib.h>
+
+struct Batch {
+	unsigned b_n;
+	struct Sysbatch b_ops[SYSBATCH_MAX];
+};
+
+#define batch	((struct Batch *) BATCHVA)
+
+static bool
+batch_mapped(void)
+{
+	return (vpd[PDX(BATCHVA)] & PTE_P) && (vpt[VPN(BATCHVA)] & PTE_P);
+}
+
+static int
+batch_add(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3,
+	  uint32_t a4, uint32_t a5)
+{
+	struct Sysbatch *op;
+	int r;
+
+	// A new env, such as a fork child, gets its own page on first use.
+	if (!batch_mapped() &&
+	    (r = sys_page_alloc(0, batch, PTE_P|PTE_U|PTE_W)) < 0)
+		return r;
+	if (batch->b_n == SYSBATCH_MAX && (r = batch_flush()) < 0)
+		return r;
+	op = &batch->b_ops[batch->b_n++];
+	op->sb_num = num;
+	op->sb_args[0] = a1;
+	op->sb_args[1] = a2;
+	op->sb_args[2] = a3;
+	op->sb_args[3] = a4;
+	op->sb_args[4] = a5;
+	return 0;
+}
+
+int
+batch_page_alloc(envid_t envid, void *va, int perm)
+{
+	return batch_add(SYS_page_alloc, envid, (uint32_t) va, perm, 0, 0);
+}
+
+int
+batch_page_map(envid_t srcenv, void *srcva, envid_t dstenv, void *dstva,
+	       int perm)
+{
+	return batch_add(SYS_page_map, srcenv, (uint32_t) srcva, dstenv,
+			 (uint32_t) dstva, perm);
+}
+
+int
+batch_page_unmap(envid_t envid, void *va)
+{
+	return batch_add(SYS_page_unmap, envid, (uint32_t) va, 0, 0, 0);
+}
+
+int
+batch_env_set_status(envid_t envid, int status)
+{
+	return batch_add(SYS_env_set_status, envid, status, 0, 0, 0);
+}
+
+// Run the queued calls.  Returns 0 if they all succeeded, otherwise
+// the error of the first that failed; the calls after it are dropped.
+int
+batch_flush(void)
+{
+	unsigned n;
+	int r;
+
+	if (!batch_mapped() || batch->b_n == 0)
+		return 0;
+	n = batch->b_n;
+	batch->b_n = 0;
+	if ((r = sys_batch(batch->b_ops, n)) < 0)
+		return r;
+	return r < n ? batch->b_ops[r].sb_ret : 0;
+}
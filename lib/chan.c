@@ -0,0 +1,115 @@
+// Channels: a lock-free single-producer, single-consumer ring on a
+// PTE_SHARE page mapped at the same address in both environments.
+//
+// Sending and receiving only touch the shared page.  The kernel is
+// involved only when one side has to wait: a consumer that finds the
+// ring empty, or a producer that finds it full, sets its waiting flag,
+// checks the ring again and blocks in sys_wait_notify.  The other side
+// clears the flag and sends it CHAN_NOTIFY after the next receive or
+// send.  So a steady stream that never empties or fills the ring costs
+// no system calls at all.
+//
+// Notifications are sticky, so one sent to a waiter that has already
+// seen the ring change is taken by its next wait, which then looks at
+// the ring once more.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+// Order our last store before our next load.  Stores are not
+// reordered with each other on x86, nor loads, but a load can pass an
+// earlier store.
+static __inline void
+chan_mb(void)
+{
+	__asm __volatile("lock; addl $0, 0(%%esp)" : : : "memory", "cc");
+}
+
+// Wait for the peer's notification, unless 'ready' holds once we
+// have set *waiting.
+static void
+chan_wait(volatile uint32_t *waiting, struct Chan *c, bool (*ready)(struct Chan *))
+{
+	*waiting = 1;
+	chan_mb();
+	if (!ready(c))
+		sys_wait_notify(CHAN_NOTIFY);
+	*waiting = 0;
+}
+
+// Wake the peer if it is waiting on *waiting.
+static void
+chan_wake(volatile uint32_t *waiting, envid_t peer)
+{
+	chan_mb();
+	if (*waiting) {
+		*waiting = 0;
+		sys_notify(peer, CHAN_NOTIFY);
+	}
+}
+
+static bool
+chan_nonempty(struct Chan *c)
+{
+	return c->ch_head != c->ch_tail;
+}
+
+static bool
+chan_nonfull(struct Chan *c)
+{
+	return c->ch_tail - c->ch_head != CHAN_NSLOT;
+}
+
+// Create a channel from 'producer' to 'consumer' at address 'c', which
+// must be page aligned and unused in both.  One of them must be us;
+// the other gets the page mapped at the same address.
+// Returns 0 on success, < 0 on error.
+int
+chan_create(struct Chan *c, envid_t producer, envid_t consumer)
+{
+	envid_t peer;
+	int r;
+
+	if (producer == env->env_id)
+		peer = consumer;
+	else if (consumer == env->env_id)
+		peer = producer;
+	else
+		return -E_INVAL;
+	if ((r = sys_page_alloc(0, c, PTE_P|PTE_U|PTE_W|PTE_SHARE)) < 0)
+		return r;
+	c->ch_producer = producer;
+	c->ch_consumer = consumer;
+	if ((r = sys_page_map(0, c, peer, c, PTE_P|PTE_U|PTE_W|PTE_SHARE)) < 0) {
+		sys_page_unmap(0, c);
+		return r;
+	}
+	return 0;
+}
+
+// Put 'v' on the ring, waiting for room if it is full.
+void
+chan_send(struct Chan *c, uint32_t v)
+{
+	uint32_t tail = c->ch_tail;
+
+	while (tail - c->ch_head == CHAN_NSLOT)
+		chan_wait(&c->ch_pwaiting, c, chan_nonfull);
+	c->ch_slot[tail % CHAN_NSLOT] = v;
+	c->ch_tail = tail + 1;
+	chan_wake(&c->ch_cwaiting, c->ch_consumer);
+}
+
+// Take the next message off the ring, waiting for one if it is empty.
+uint32_t
+chan_recv(struct Chan *c)
+{
+	uint32_t head = c->ch_head, v;
+
+	while (head == c->ch_tail)
+		chan_wait(&c->ch_cwaiting, c, chan_nonempty);
+	v = c->ch_slot[head % CHAN_NSLOT];
+	c->ch_head = head + 1;
+	chan_wake(&c->ch_pwaiting, c->ch_producer);
+	return v;
+}
@@ -198,8 +198,10 @@ fmap(struct Fd* fd, off_t oldsize, off_t newsize)
     if (oldsize >= newsize) {
         return 0;
     }
-    for (i = ROUNDUP(oldsize, PGSIZE); i < newsize; i += PGSIZE) {
-        if ((r = fsipc_map(fd->fd_file.id, i, fd2data(fd) + i)) < 0) {
+    // Map up to IPC_MAXPAGES blocks per request.
+    for (i = ROUNDUP(oldsize, PGSIZE); i < newsize; i += r * PGSIZE) {
+        r = MIN(ROUNDUP(newsize - i, PGSIZE) / PGSIZE, IPC_MAXPAGES);
+        if ((r = fsipc_mapv(fd->fd_file.id, i, fd2data(fd) + i, r)) < 0) {
             goto out;
         }
     }
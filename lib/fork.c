@@ -78,11 +78,14 @@ pgfault(struct UTrapframe *utf)
 
 //
 // Map our virtual page pn (address pn*PGSIZE) into the target envid
-// at the same virtual address.  If the page is writable or copy-on-write,
+// at the same virtual address.  A PTE_SHARE page is mapped as it is,
+// so that both envs keep sharing it.  If the page is writable or copy-on-write,
 // the new mapping must be created copy-on-write, and then our mapping must be
 // marked copy-on-write as well.  (Exercise: Why mark ours copy-on-write again
 // if it was already copy-on-write?)
 //
+// The system calls are queued with batch_page_map; fork flushes them.
+//
 // Returns: 0 on success, < 0 on error.
 // It is also OK to panic on error.
 // 
@@ -102,18 +105,21 @@ duppage(envid_t envid, unsigned pn)
     ptx = PTX(addr);
     pt = (int *) ((PDX(UVPT) << PDXSHIFT) | (pdx << PTXSHIFT));
     pte = (pte_t) pt[ptx];
-    if (pte & PTE_COW) {
-        sys_page_map(0, (void *) addr, envid, (void *) addr,
-                     PTE_U|PTE_P|PTE_COW);
-        return 0;
-    }
+    if (pte & PTE_SHARE)
+        return batch_page_map(0, (void *) addr, envid, (void *) addr,
+                              pte & PTE_USER);
+    if (pte & PTE_COW)
+        return batch_page_map(0, (void *) addr, envid, (void *) addr,
+                              PTE_U|PTE_P|PTE_COW);
     if ((pte & PTE_W) || (pte & PTE_COW)) {
         pte &= !PTE_W;
         pte |= PTE_COW;
     }
-    sys_page_map(0, (void *) addr, envid, (void *) addr, PTE_U|PTE_P|PTE_COW);
-    sys_page_map(0, (void *) addr, 0, (void *) addr, PTE_U|PTE_P|PTE_COW);
-	return 0;
+    if ((r = batch_page_map(0, (void *) addr, envid, (void *) addr,
+                            PTE_U|PTE_P|PTE_COW)) < 0)
+        return r;
+    return batch_page_map(0, (void *) addr, 0, (void *) addr,
+                          PTE_U|PTE_P|PTE_COW);
 }
 
 //
@@ -138,13 +144,17 @@ fork(void)
 	// LAB 4: Your code here.
     envid_t envid;
     uint32_t addr;
-    int ptx, i, j;
+    int ptx, i, j, r;
 
     dprintk("[FORK] Setting pgfault handler for env[%x]\n", env->env_id);
     set_pgfault_handler(pgfault);
     envid = sys_exofork();
 
     if (envid != 0) {
+        extern void *_pgfault_upcall(void);
+        sys_env_set_pgfault_upcall(envid, _pgfault_upcall);
+
+        // Everything from here on goes to the kernel in batches.
         for (i = 0; i < PDX(UTOP); i++) {
             if (!(vpd[i] & PTE_P))
                 continue;
@@ -154,18 +164,22 @@ fork(void)
                 /* Skip exeption stack page */
                 if (i == PDX(UXSTACKTOP-PGSIZE) && j == PTX(UXSTACKTOP-PGSIZE))
                     continue;
-                if (vpt[i * NPTENTRIES + j] & PTE_P) {
-                    duppage(envid, i * NPTENTRIES + j);
-                }
+                /* Nor the batch queue, the child gets its own */
+                if (i == PDX(BATCHVA) && j == PTX(BATCHVA))
+                    continue;
+                if ((vpt[i * NPTENTRIES + j] & PTE_P) &&
+                    (r = duppage(envid, i * NPTENTRIES + j)) < 0)
+                    panic("fork: duppage: %e", r);
             }
         }
         
-        extern void *_pgfault_upcall(void);
-        sys_page_alloc(envid, (void *) UXSTACKTOP - PGSIZE, PTE_U|PTE_P|PTE_W);
-        sys_env_set_pgfault_upcall(envid, _pgfault_upcall);
-        sys_env_set_status(envid, ENV_RUNNABLE);
+        if ((r = batch_page_alloc(envid, (void *) UXSTACKTOP - PGSIZE,
+                                  PTE_U|PTE_P|PTE_W)) < 0 ||
+            (r = batch_env_set_status(envid, ENV_RUNNABLE)) < 0 ||
+            (r = batch_flush()) < 0)
+            panic("fork: %e", r);
     } else {
-		env = &envs[ENVX(sys_getenvid())];
+		env = &envs[ENVX(envinfo.ei_envid)];
     }
     
     return envid;
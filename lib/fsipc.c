@@ -5,23 +5,42 @@
 
 extern uint8_t fsipcbuf[PGSIZE];	// page-aligned, declared in entry.S
 
-// Send an IP request to the file server, and wait for a reply.
+// Send an IP request to the file server's endpoint, FS_ENDPOINT, and
+// wait for the reply of whichever server worker takes it, with a
+// single ipc_call_ep.
 // type: request code, passed as the simple integer IPC value.
 // fsreq: page to send containing additional request data, usually fsipcbuf.
 //	  Can be modified by server to return additional response info.
-// dstva: virtual address at which to receive reply page, 0 if none.
-// *perm: permissions of received page.
+// dstva: virtual address at which to receive reply pages, 0 if none.
+// npages: number of reply pages there is room for at dstva.
 // Returns 0 if successful, < 0 on failure.
 static int
-fsipc(unsigned type, void *fsreq, void *dstva, int *perm)
+fsipcv(unsigned type, void *fsreq, void *dstva, unsigned npages)
 {
-	envid_t whom;
+	struct Ipc_msg m;
 
 	if (debug)
 		cprintf("[%08x] fsipc %d %08x\n", env->env_id, type, fsipcbuf);
 
-	ipc_send(envs[1].env_id, type, fsreq, PTE_P | PTE_W | PTE_U);
-	return ipc_recv(&whom, dstva, perm);
+	memset(&m, 0, sizeof(m));
+	m.im_regs[0] = type;
+	m.im_npages = 1;
+	m.im_pages[0] = fsreq;
+	m.im_perm = PTE_P | PTE_W | PTE_U;
+	return ipc_call_ep(FS_ENDPOINT, &m, dstva, npages);
+}
+
+// Like fsipcv, for at most one reply page.
+// *perm: permissions of received page.
+static int
+fsipc(unsigned type, void *fsreq, void *dstva, int *perm)
+{
+	int r;
+
+	r = fsipcv(type, fsreq, dstva, dstva ? 1 : 0);
+	if (perm)
+		*perm = r < 0 ? 0 : env->env_ipc_perm;
+	return r;
 }
 
 // Send file-open request to the file server.
@@ -52,8 +71,7 @@ fsipc_open(const char *path, int omode, struct Fd *fd)
 int
 fsipc_map(int fileid, off_t offset, void *dstva)
 {
-	int r, perm;
-	struct Fsreq_map *req;
+	int r;
 
 	// Fill out request with file and offset.
 	// Send request to file server with fsipc.
@@ -62,18 +80,33 @@ fsipc_map(int fileid, off_t offset, void *dstva)
 	// returned page are at least PTE_U and PTE_P.
 
 	// LAB 5: Your code here.
-    req = (struct Fsreq_map *) fsipcbuf;
-    req->req_fileid = fileid;
-    req->req_offset = offset;
-    r = fsipc(FSREQ_MAP, (void *) req, dstva, &perm);
-    if (r < 0)
+    if ((r = fsipc_mapv(fileid, offset, dstva, 1)) < 0)
         return r;
-    if ((perm & (PTE_U | PTE_P)) != (PTE_U | PTE_P))
-        panic("fsipc_map return illegal permissions");
-	
 	return 0;
 }
 
+// Like fsipc_map, but ask for up to 'npages' consecutive blocks,
+// mapped at consecutive pages from dstva, in one round trip.  The
+// server sends fewer if the file ends first.
+// Returns the number of pages mapped, < 0 on failure.
+int
+fsipc_mapv(int fileid, off_t offset, void *dstva, int npages)
+{
+	struct Fsreq_map *req;
+	int r;
+
+	req = (struct Fsreq_map *) fsipcbuf;
+	req->req_fileid = fileid;
+	req->req_offset = offset;
+	req->req_npages = npages;
+	if ((r = fsipcv(FSREQ_MAP, req, dstva, npages)) < 0)
+		return r;
+	if (env->env_ipc_npages == 0 ||
+	    (env->env_ipc_perm & (PTE_U | PTE_P)) != (PTE_U | PTE_P))
+		panic("fsipc_mapv return illegal permissions");
+	return env->env_ipc_npages;
+}
+
 // Make a set-file-size request to the file server.
 int
 fsipc_set_size(int fileid, off_t size)
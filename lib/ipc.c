@@ -21,11 +21,23 @@
 int32_t
 ipc_recv(envid_t *from_env_store, void *pg, int *perm_store)
 {
-	// LAB 4: Your code here.
-    if (pg) {
-        sys_ipc_recv(pg);
-    } else {
-        sys_ipc_recv((void *) -1);
+	return ipc_recv_timeout(from_env_store, pg, perm_store, 0);
+}
+
+// Like ipc_recv, but give up and return -E_TIMEOUT if nothing arrives
+// within 'ticks' clock ticks.  0 means wait forever.
+int32_t
+ipc_recv_timeout(envid_t *from_env_store, void *pg, int *perm_store,
+		 unsigned ticks)
+{
+    int r;
+
+    if ((r = sys_ipc_recv_timeout(pg ? pg : (void *) -1, ticks)) < 0) {
+        if (from_env_store)
+            *from_env_store = 0;
+        if (perm_store)
+            *perm_store = 0;
+        return r;
     }
     dprintk("[IPC] from %08x to %08x\n", env->env_ipc_from, env->env_id);
     if (from_env_store)
@@ -35,14 +47,91 @@ ipc_recv(envid_t *from_env_store, void *pg, int *perm_store)
 	return env->env_ipc_value;
 }
 
+// Send the message 'msg', its registers and pages, to 'toenv'.
+// The kernel blocks us until 'toenv' receives it.
+// Returns the number of pages 'toenv' took, or the error.
+int
+ipc_sendv(envid_t to_env, const struct Ipc_msg *msg)
+{
+	return sys_ipc_sendv(to_env, msg);
+}
+
+// Receive a message of up to 'npages' pages, mapped at consecutive
+// pages from 'pg'.  If 'regs_store' is nonnull, store the IPC_NREGS
+// message registers there.  'fromenv' is stored as for ipc_recv.
+// Returns the number of pages received, or the error.
+int
+ipc_recvv(envid_t *from_env_store, void *pg, unsigned npages,
+	  uint32_t *regs_store)
+{
+	int r;
+
+	if ((r = sys_ipc_recvv(pg ? pg : (void *) -1, npages, 0)) < 0) {
+		if (from_env_store)
+			*from_env_store = 0;
+		return r;
+	}
+	if (from_env_store)
+		*from_env_store = env->env_ipc_from;
+	if (regs_store)
+		memmove(regs_store, (void *) env->env_ipc_regs,
+			sizeof(env->env_ipc_regs));
+	return env->env_ipc_npages;
+}
+
+// Send 'msg' to 'toenv' and wait for its reply, which may map up to
+// 'npages' pages from 'pg'.  No other message can come in between.
+// Returns the reply's value, or the error.  env->env_ipc_npages and
+// env->env_ipc_perm describe the pages received.
+int32_t
+ipc_call(envid_t to_env, const struct Ipc_msg *msg, void *pg, unsigned npages)
+{
+	int r;
+
+	if ((r = sys_ipc_call(to_env, msg, pg ? pg : (void *) -1, npages)) < 0)
+		return r;
+	return env->env_ipc_value;
+}
+
+// Like ipc_call, but call whichever worker of endpoint 'ep' is free.
+int32_t
+ipc_call_ep(int ep, const struct Ipc_msg *msg, void *pg, unsigned npages)
+{
+	int r;
+
+	if ((r = sys_ep_call(ep, msg, pg ? pg : (void *) -1, npages)) < 0)
+		return r;
+	return env->env_ipc_value;
+}
+
+// Send 'reply' to 'toenv', which is waiting for it in ipc_call, and
+// receive the next message like ipc_recv_timeout, in one system call.
+// If 'reply' is null, only receive.
+int32_t
+ipc_reply_recv(envid_t to_env, const struct Ipc_msg *reply,
+	       envid_t *from_env_store, void *pg, int *perm_store,
+	       unsigned ticks)
+{
+	int r;
+
+	if ((r = sys_ipc_reply_recv(to_env, reply, pg ? pg : (void *) -1,
+				    1, ticks)) < 0) {
+		if (from_env_store)
+			*from_env_store = 0;
+		if (perm_store)
+			*perm_store = 0;
+		return r;
+	}
+	if (from_env_store)
+		*from_env_store = env->env_ipc_from;
+	if (perm_store)
+		*perm_store = env->env_ipc_perm;
+	return env->env_ipc_value;
+}
+
 // Send 'val' (and 'pg' with 'perm', assuming 'pg' is nonnull) to 'toenv'.
-// This function keeps trying until it succeeds.
-// It should panic() on any error other than -E_IPC_NOT_RECV.
-//
-// Hint:
-//   Use sys_yield() to be CPU-friendly.
-//   If 'pg' is null, pass sys_ipc_recv a value that it will understand
-//   as meaning "no page".  (Zero is not the right value.)
+// The kernel blocks us until 'toenv' receives it.
+// Panics on any error.
 void
 ipc_send(envid_t to_env, uint32_t val, void *pg, int perm)
 {
@@ -51,17 +140,8 @@ ipc_send(envid_t to_env, uint32_t val, void *pg, int perm)
 
     dprintk("[IPC] send from %08x to %08x, value=%d, pg=%p, perm=%x\n",
             sys_getenvid(), to_env, val, pg, perm);
-    while (1) {
-        if (pg == NULL) {
-            /* TODO: allow pg=0 */
-            ret = sys_ipc_try_send(to_env, val, (void *) -1, 0);
-        } else {
-            ret = sys_ipc_try_send(to_env, val, pg, perm);
-        }
-        if (ret == 0 || ret == 1)
-            break;
-        if (ret != -E_IPC_NOT_RECV)
-            panic("ipc_send error %e", ret);
-    }
+    /* TODO: allow pg=0 */
+    if ((ret = sys_ipc_send(to_env, val, pg ? pg : (void *) -1, perm)) < 0)
+        panic("ipc_send error %e", ret);
 }
 
@@ -13,9 +13,7 @@ libmain(int argc, char **argv)
 {
 	// set env to point at our env structure in envs[].
 	// LAB 3: Your code here.
-    int32_t envx;
-    envx = ENVX(sys_getenvid());
-	env = & ((struct Env *) UENVS) [envx];
+	env = &envs[ENVX(envinfo.ei_envid)];
 
 	// save the name of the program so that panic() can use it
 	if (argc > 0)
@@ -9,6 +9,7 @@
 static int init_stack(envid_t child, const char **argv, uintptr_t *init_esp);
 static int map_segment(envid_t child, uintptr_t va, size_t memsz,
 		       int fd, size_t filesz, off_t fileoffset, int perm);
+static int copy_shared_pages(envid_t child);
 
 // Spawn a child process from a program image loaded from the file system.
 // prog: the pathname of the program to run.
@@ -67,6 +68,9 @@ spawn(const char *prog, const char **argv)
 	close(fd);
 	fd = -1;
 
+	if ((r = copy_shared_pages(child)) < 0)
+		goto error;
+
     cprintf("sys_env_set_trapframe\n");
 	if ((r = sys_env_set_trapframe(child, &child_tf)) < 0)
 		panic("sys_env_set_trapframe: %e", r);
@@ -146,9 +150,11 @@ init_stack(envid_t child, const char **argv, uintptr_t *init_esp)
 	
 	// After completing the stack, map it into the child's address space
 	// and unmap it from ours!
-	if ((r = sys_page_map(0, UTEMP, child, (void*) (USTACKTOP - PGSIZE), PTE_P | PTE_U | PTE_W)) < 0)
+	if ((r = batch_page_map(0, UTEMP, child, (void*) (USTACKTOP - PGSIZE), PTE_P | PTE_U | PTE_W)) < 0)
+		goto error;
+	if ((r = batch_page_unmap(0, UTEMP)) < 0)
 		goto error;
-	if ((r = sys_page_unmap(0, UTEMP)) < 0)
+	if ((r = batch_flush()) < 0)
 		goto error;
 	
 	return 0;
@@ -174,32 +180,61 @@ map_segment(envid_t child, uintptr_t va, size_t memsz,
 		fileoffset -= i;
 	}
 
+	// The page calls are batched.  Only reading a data page into
+	// UTEMP needs the calls queued so far to have run.
 	for (i = 0; i < memsz; i += PGSIZE) {
 		if (i >= filesz) {
 			// allocate a blank page
-			if ((r = sys_page_alloc(child, (void*) (va + i), perm)) < 0)
+			if ((r = batch_page_alloc(child, (void*) (va + i), perm)) < 0)
 				return r;
 		} else {
 			// from file
 			if (perm & PTE_W) {
-				// must make a copy so it can be writable
-				if ((r = sys_page_alloc(0, UTEMP, PTE_P|PTE_U|PTE_W)) < 0)
+				// must make a copy so it can be writable; the
+				// new page replaces the one UTEMP last held,
+				// which the child keeps
+				if ((r = batch_page_alloc(0, UTEMP, PTE_P|PTE_U|PTE_W)) < 0)
+					return r;
+				if ((r = batch_flush()) < 0)
 					return r;
 				if ((r = seek(fd, fileoffset + i)) < 0)
 					return r;
 				if ((r = read(fd, UTEMP, MIN(PGSIZE, filesz-i))) < 0)
 					return r;
-				if ((r = sys_page_map(0, UTEMP, child, (void*) (va + i), perm)) < 0)
-					panic("spawn: sys_page_map data: %e", r);
-				sys_page_unmap(0, UTEMP);
+				if ((r = batch_page_map(0, UTEMP, child, (void*) (va + i), perm)) < 0)
+					return r;
 			} else {
 				// can map buffer cache read only
 				if ((r = read_map(fd, fileoffset + i, &blk)) < 0)
 					return r;
-				if ((r = sys_page_map(0, blk, child, (void*) (va + i), perm)) < 0)
-					panic("spawn: sys_page_map text: %e", r);
+				if ((r = batch_page_map(0, blk, child, (void*) (va + i), perm)) < 0)
+					return r;
 			}
 		}
 	}
-	return 0;
+	if ((r = batch_page_unmap(0, UTEMP)) < 0)
+		return r;
+	return batch_flush();
+}
+
+// Map every PTE_SHARE page of ours into the child at the same address,
+// as fork does, so that the child shares them with us.
+static int
+copy_shared_pages(envid_t child)
+{
+	uintptr_t va;
+	int r;
+
+	for (va = 0; va < UTOP; va += PGSIZE) {
+		if (!(vpd[PDX(va)] & PTE_P)) {
+			va += PTSIZE - PGSIZE;
+			continue;
+		}
+		if ((vpt[VPN(va)] & (PTE_P|PTE_SHARE)) != (PTE_P|PTE_SHARE))
+			continue;
+		if ((r = batch_page_map(0, (void*) va, child, (void*) va,
+					vpt[VPN(va)] & PTE_USER)) < 0)
+			return r;
+	}
+	return batch_flush();
 }
@@ -0,0 +1,112 @@
+// Mutexes, condition variables and semaphores on top of
+// sys_futex_wait and sys_futex_wake.  The uncontended paths are a
+// single locked instruction; the kernel is only entered to sleep, or
+// to wake somebody who is known to be sleeping.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+void
+mutex_init(struct Mutex *m)
+{
+	m->m_state = 0;
+}
+
+void
+mutex_lock(struct Mutex *m)
+{
+	uint32_t c;
+
+	if ((c = cmpxchg(&m->m_state, 0, 1)) == 0)
+		return;
+	// Contended: mark the mutex so that the holder's unlock wakes
+	// us, and sleep until we are the one to take it from 0.
+	if (c != 2)
+		c = xchg(&m->m_state, 2);
+	while (c != 0) {
+		sys_futex_wait(&m->m_state, 2);
+		c = xchg(&m->m_state, 2);
+	}
+}
+
+void
+mutex_unlock(struct Mutex *m)
+{
+	if (xchg(&m->m_state, 0) == 2)
+		sys_futex_wake(&m->m_state, 1);
+}
+
+void
+cond_init(struct Cond *c)
+{
+	c->c_seq = 0;
+	c->c_waiters = 0;
+}
+
+// Release m, wait for a signal on c and take m again.  As with any
+// condition variable, callers re-check their condition in a loop.
+void
+cond_wait(struct Cond *c, struct Mutex *m)
+{
+	uint32_t seq;
+
+	seq = c->c_seq;
+	xadd(&c->c_waiters, 1);
+	mutex_unlock(m);
+	// A signal after we read seq changes it, and the wait returns
+	// at once.
+	sys_futex_wait(&c->c_seq, seq);
+	xadd(&c->c_waiters, -1);
+	mutex_lock(m);
+}
+
+void
+cond_signal(struct Cond *c)
+{
+	xadd(&c->c_seq, 1);
+	if (c->c_waiters)
+		sys_futex_wake(&c->c_seq, 1);
+}
+
+void
+cond_broadcast(struct Cond *c)
+{
+	xadd(&c->c_seq, 1);
+	if (c->c_waiters)
+		sys_futex_wake(&c->c_seq, c->c_waiters);
+}
+
+void
+sem_init(struct Sem *s, uint32_t count)
+{
+	s->s_count = count;
+	s->s_waiters = 0;
+}
+
+void
+sem_wait(struct Sem *s)
+{
+	uint32_t c;
+
+	while (1) {
+		c = s->s_count;
+		if (c > 0) {
+			if (cmpxchg(&s->s_count, c, c - 1) == c)
+				return;
+			continue;
+		}
+		// Count ourselves before the kernel looks at s_count, so
+		// that a sem_post that makes it non-zero sees us.
+		xadd(&s->s_waiters, 1);
+		sys_futex_wait(&s->s_count, 0);
+		xadd(&s->s_waiters, -1);
+	}
+}
+
+void
+sem_post(struct Sem *s)
+{
+	xadd(&s->s_count, 1);
+	if (s->s_waiters)
+		sys_futex_wake(&s->s_count, 1);
+}
@@ -15,28 +15,28 @@ syscall(int num, int check, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 	// The last clause tells the assembler that this can
 	// potentially change the condition codes and arbitrary
 	// memory locations.
+	//
+	// sysenter saves neither eip nor esp, so we pass them in %esi
+	// and %ebp, which leaves no register for a5: it goes on the
+	// stack, above our saved %ebp, and the kernel only reads it for
+	// the calls that take it.  sysexit returns through %edx and
+	// %ecx, so they come back clobbered.
 
-    asm volatile(
-                 "pushl %%ebp\n\t"
-                 "pushl %%esi\n\t"
-                 "pushl %6\n\t"
-                 "movl $1f, %%esi\n\t"
-                 "movl %%esp, %%ebp\n\t"
-                 "nop\n\t"
-                 "sysenter\n\t"
-                 "1:\n\t"
-                 "sti\n\t"
-                 "popl %%esi\n\t"
-                 "popl %%esi\n\t"
-                 "popl %%ebp\n\t"
-                 : "=a" (ret)
-                 : "a" (num),
-                   "d" (a1),
-                   "c" (a2),
-                   "b" (a3),
-                   "D" (a4),
-                   "m" (a5)
-                 : "cc", "memory");
+	asm volatile("pushl %[a5]\n\t"
+		     "pushl %%ebp\n\t"
+		     "movl %%esp, %%ebp\n\t"
+		     "movl $1f, %%esi\n\t"
+		     "sysenter\n"
+		     "1:\tpopl %%ebp\n\t"
+		     "addl $4, %%esp\n\t"
+		     : "=a" (ret),
+		       "+d" (a1),
+		       "+c" (a2)
+		     : "a" (num),
+		       "b" (a3),
+		       "D" (a4),
+		       [a5] "m" (a5)
+		     : "esi", "cc", "memory");
 
 	if(check && ret > 0)
 		panic("syscall %d returned %d (> 0)", num, ret);
@@ -62,10 +62,17 @@ sys_env_destroy(envid_t envid)
 	return syscall(SYS_env_destroy, 1, envid, 0, 0, 0, 0);
 }
 
+// Our id is in our read-only Envinfo page, no need to ask the kernel.
 envid_t
 sys_getenvid(void)
 {
-	 return syscall(SYS_getenvid, 0, 0, 0, 0, 0, 0);
+	return envinfo.ei_envid;
+}
+
+int
+sys_yield_to(envid_t envid)
+{
+	return syscall(SYS_yield_to, 0, envid, 0, 0, 0, 0);
 }
 
 void
@@ -100,6 +107,24 @@ sys_env_set_status(envid_t envid, int status)
 	return syscall(SYS_env_set_status, 1, envid, status, 0, 0, 0);
 }
 
+int
+sys_env_set_priority(envid_t envid, int prio)
+{
+	return syscall(SYS_env_set_priority, 1, envid, prio, 0, 0, 0);
+}
+
+int
+sys_env_set_tickets(envid_t envid, uint32_t tickets)
+{
+	return syscall(SYS_env_set_tickets, 1, envid, tickets, 0, 0, 0);
+}
+
+int
+sys_env_set_reservation(envid_t envid, uint32_t budget, uint32_t period)
+{
+	return syscall(SYS_env_set_reservation, 1, envid, budget, period, 0, 0);
+}
+
 int
 sys_env_set_trapframe(envid_t envid, struct Trapframe *tf)
 {
@@ -118,12 +143,155 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, int perm)
 	return syscall(SYS_ipc_try_send, 0, envid, value, (uint32_t) srcva, perm, 0);
 }
 
+int
+sys_ipc_sendv(envid_t envid, const struct Ipc_msg *msg)
+{
+	return syscall(SYS_ipc_sendv, 0, envid, (uint32_t) msg, 0, 0, 0);
+}
+
+int
+sys_ipc_recvv(void *dstva, unsigned npages, unsigned ticks)
+{
+	return syscall(SYS_ipc_recvv, 0, (uint32_t) dstva, npages, ticks, 0, 0);
+}
+
+int
+sys_ipc_call(envid_t envid, const struct Ipc_msg *msg, void *dstva,
+	     unsigned npages)
+{
+	return syscall(SYS_ipc_call, 0, envid, (uint32_t) msg,
+		       (uint32_t) dstva, npages, 0);
+}
+
+int
+sys_ipc_reply_recv(envid_t envid, const struct Ipc_msg *reply, void *dstva,
+		   unsigned npages, unsigned ticks)
+{
+	return syscall(SYS_ipc_reply_recv, 0, envid, (uint32_t) reply,
+		       (uint32_t) dstva, npages, ticks);
+}
+
+int
+sys_ipc_send(envid_t envid, uint32_t value, void *srcva, int perm)
+{
+	return syscall(SYS_ipc_send, 0, envid, value, (uint32_t) srcva, perm, 0);
+}
+
 int
 sys_ipc_recv(void *dstva)
 {
 	return syscall(SYS_ipc_recv, 1, (uint32_t)dstva, 0, 0, 0, 0);
 }
 
+int
+sys_ipc_recv_timeout(void *dstva, unsigned ticks)
+{
+	return syscall(SYS_ipc_recv, 0, (uint32_t)dstva, ticks, 0, 0, 0);
+}
+
+int
+sys_sleep(unsigned ticks)
+{
+	return syscall(SYS_sleep, 0, ticks, 0, 0, 0, 0);
+}
+
+int
+sys_notify(envid_t envid, uint32_t bits)
+{
+	return syscall(SYS_notify, 0, envid, bits, 0, 0, 0);
+}
+
+uint32_t
+sys_wait_notify(uint32_t mask)
+{
+	return syscall(SYS_wait_notify, 0, mask, 0, 0, 0, 0);
+}
+
+int
+sys_ep_create(int ep)
+{
+	return syscall(SYS_ep_create, 1, ep, 0, 0, 0, 0);
+}
+
+int
+sys_ep_bind(int ep)
+{
+	return syscall(SYS_ep_bind, 1, ep, 0, 0, 0, 0);
+}
+
+int
+sys_ep_call(int ep, const struct Ipc_msg *msg, void *dstva, unsigned npages)
+{
+	return syscall(SYS_ep_call, 0, ep, (uint32_t) msg, (uint32_t) dstva,
+		       npages, 0);
+}
+
+int
+sys_futex_wait(volatile uint32_t *va, uint32_t expected)
+{
+	return syscall(SYS_futex_wait, 1, (uint32_t) va, expected, 0, 0, 0);
+}
+
+int
+sys_futex_wake(volatile uint32_t *va, int n)
+{
+	return syscall(SYS_futex_wake, 1, (uint32_t) va, n, 0, 0, 0);
+}
+
+int
+sys_shm_create(uint32_t key, unsigned npages)
+{
+	return syscall(SYS_shm_create, 0, key, npages, 0, 0, 0);
+}
+
+int
+sys_shm_attach(uint32_t key, void *va, int perm)
+{
+	return syscall(SYS_shm_attach, 0, key, (uint32_t) va, perm, 0, 0);
+}
+
+int
+sys_shm_detach(void *va)
+{
+	return syscall(SYS_shm_detach, 1, (uint32_t) va, 0, 0, 0, 0);
+}
+
+int
+sys_shm_destroy(uint32_t key)
+{
+	return syscall(SYS_shm_destroy, 1, key, 0, 0, 0, 0);
+}
+
+int
+sys_batch(struct Sysbatch *ops, unsigned n)
+{
+	return syscall(SYS_batch, 0, (uint32_t) ops, n, 0, 0, 0);
+}
+
+int
+sys_page_alloc_range(envid_t envid, void *va, size_t len, int perm)
+{
+	return syscall(SYS_page_alloc_range, 1, envid, (uint32_t) va, len,
+		       perm, 0);
+}
+
+// The kernel takes len and perm in one register; see sys_page_map_range.
+int
+sys_page_map_range(envid_t srcenv, void *srcva, envid_t dstenv, void *dstva,
+		   size_t len, int perm)
+{
+	if (PGOFF(len))
+		return -E_INVAL;
+	return syscall(SYS_page_map_range, 1, srcenv, (uint32_t) srcva,
+		       dstenv, (uint32_t) dstva, len | PGOFF(perm));
+}
+
+int
+sys_page_unmap_range(envid_t envid, void *va, size_t len)
+{
+	return syscall(SYS_page_unmap_range, 1, envid, (uint32_t) va, len, 0, 0);
+}
+
 int
 sys_debug_va_mapping(uint32_t va)
 {
@@ -0,0 +1,24 @@
+// Reading the clock without system calls, from the kernel's read-only
+// Kinfo page at UKINFO.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+// Clock ticks since the kernel started the clock, as the kernel's
+// kclock_ticks() counts them.
+uint32_t
+time_ticks(void)
+{
+	uint64_t per_tick = kinfo.ki_tsc_freq / kinfo.ki_hz;
+
+	return (read_tsc() - kinfo.ki_tsc_boot) / (per_tick ? per_tick : 1);
+}
+
+// Milliseconds since the kernel started the clock.
+uint64_t
+time_msec(void)
+{
+	uint64_t per_msec = kinfo.ki_tsc_freq / 1000;
+
+	return (read_tsc() - kinfo.ki_tsc_boot) / (per_msec ? per_msec : 1);
+}
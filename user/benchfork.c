@@ -0,0 +1,38 @@
+// Benchmark fork plus exit: the time from calling fork until the
+// child, which exits straight away, has been freed.
+// Results are lines of the form "bench <name> <iterations> <cycles>",
+// with cycles per operation; bench.sh collects them.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define N		100
+
+static void
+report(const char *name, int n, uint64_t cycles)
+{
+	cprintf("bench %s %d %llu\n", name, n, cycles / n);
+}
+
+void
+umain(void)
+{
+	volatile struct Env *e;
+	uint64_t start;
+	envid_t kid;
+	int i;
+
+	binaryname = "benchfork";
+
+	start = read_tsc();
+	for (i = 0; i < N; i++) {
+		if ((kid = fork()) < 0)
+			panic("fork: %e", kid);
+		if (kid == 0)
+			exit();
+		e = &envs[ENVX(kid)];
+		while (e->env_id == kid && e->env_status != ENV_FREE)
+			sys_yield();
+	}
+	report("fork_exit", N, read_tsc() - start);
+}
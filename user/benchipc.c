@@ -0,0 +1,68 @@
+// Benchmark ipc_send/ipc_recv round trips with a child echoing every
+// message back, first with a value only and then passing a page each
+// way.
+// Results are lines of the form "bench <name> <iterations> <cycles>",
+// with cycles per operation; bench.sh collects them.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define N		10000
+
+#define PAGE		((void *) 0x10000000)
+
+static void
+report(const char *name, int n, uint64_t cycles)
+{
+	cprintf("bench %s %d %llu\n", name, n, cycles / n);
+}
+
+static void
+echo(void)
+{
+	envid_t who;
+	int perm, v;
+
+	while (1) {
+		v = ipc_recv(&who, PAGE, &perm);
+		ipc_send(who, v, perm ? PAGE : 0, perm);
+	}
+}
+
+static void
+roundtrips(const char *name, envid_t kid, void *pg)
+{
+	uint64_t start;
+	int i, perm = pg ? PTE_P|PTE_U|PTE_W : 0;
+
+	// Make sure the child is waiting before starting the clock.
+	ipc_send(kid, 0, pg, perm);
+	ipc_recv(0, pg, 0);
+
+	start = read_tsc();
+	for (i = 0; i < N; i++) {
+		ipc_send(kid, i, pg, perm);
+		ipc_recv(0, pg, 0);
+	}
+	report(name, N, read_tsc() - start);
+}
+
+void
+umain(void)
+{
+	envid_t kid;
+	int r;
+
+	binaryname = "benchipc";
+
+	if ((kid = fork()) < 0)
+		panic("fork: %e", kid);
+	if (kid == 0)
+		echo();
+
+	roundtrips("ipc_roundtrip", kid, 0);
+	if ((r = sys_page_alloc(0, PAGE, PTE_P|PTE_U|PTE_W)) < 0)
+		panic("sys_page_alloc: %e", r);
+	roundtrips("ipc_roundtrip_page", kid, PAGE);
+	sys_env_destroy(kid);
+}
@@ -0,0 +1,73 @@
+// Benchmark sys_page_alloc, sys_page_map and sys_page_unmap over a run
+// of NPAGES pages, repeated NROUNDS times, one call at a time and
+// then queued through sys_batch.
+// Results are lines of the form "bench <name> <iterations> <cycles>",
+// with cycles per operation; bench.sh collects them.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NPAGES		256
+#define NROUNDS		20
+
+#define SRC		((uint8_t *) 0x10000000)
+#define DST		((uint8_t *) 0x20000000)
+
+static void
+report(const char *name, int n, uint64_t cycles)
+{
+	cprintf("bench %s %d %llu\n", name, n, cycles / n);
+}
+
+void
+umain(void)
+{
+	uint64_t start, talloc = 0, tmap = 0, tunmap = 0, tbatch = 0;
+	int i, j, r;
+
+	binaryname = "benchpage";
+
+	for (j = 0; j < NROUNDS; j++) {
+		start = read_tsc();
+		for (i = 0; i < NPAGES; i++)
+			if ((r = sys_page_alloc(0, SRC + i * PGSIZE,
+						PTE_P|PTE_U|PTE_W)) < 0)
+				panic("sys_page_alloc: %e", r);
+		talloc += read_tsc() - start;
+
+		start = read_tsc();
+		for (i = 0; i < NPAGES; i++)
+			if ((r = sys_page_map(0, SRC + i * PGSIZE,
+					      0, DST + i * PGSIZE,
+					      PTE_P|PTE_U|PTE_W)) < 0)
+				panic("sys_page_map: %e", r);
+		tmap += read_tsc() - start;
+
+		start = read_tsc();
+		for (i = 0; i < NPAGES; i++) {
+			sys_page_unmap(0, SRC + i * PGSIZE);
+			sys_page_unmap(0, DST + i * PGSIZE);
+		}
+		tunmap += read_tsc() - start;
+	}
+	report("page_alloc", NPAGES * NROUNDS, talloc);
+	report("page_map", NPAGES * NROUNDS, tmap);
+	report("page_unmap", 2 * NPAGES * NROUNDS, tunmap);
+
+	for (j = 0; j < NROUNDS; j++) {
+		start = read_tsc();
+		for (i = 0; i < NPAGES; i++)
+			batch_page_alloc(0, SRC + i * PGSIZE, PTE_P|PTE_U|PTE_W);
+		for (i = 0; i < NPAGES; i++)
+			batch_page_map(0, SRC + i * PGSIZE, 0, DST + i * PGSIZE,
+				       PTE_P|PTE_U|PTE_W);
+		for (i = 0; i < NPAGES; i++) {
+			batch_page_unmap(0, SRC + i * PGSIZE);
+			batch_page_unmap(0, DST + i * PGSIZE);
+		}
+		if ((r = batch_flush()) < 0)
+			panic("batch_flush: %e", r);
+		tbatch += read_tsc() - start;
+	}
+	report("page_batch", 4 * NPAGES * NROUNDS, tbatch);
+}
@@ -0,0 +1,81 @@
+// Benchmark setting up and tearing down a 4 MB region, one page per
+// system call and then with the range calls: allocate it, map it
+// again elsewhere, and unmap both.
+// Results are lines of the form "bench <name> <iterations> <cycles>",
+// with cycles per 4 MB region; bench.sh collects them.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define LEN		PTSIZE
+#define NROUNDS		10
+
+#define SRC		((uint8_t *) 0x10000000)
+#define DST		((uint8_t *) 0x20000000)
+
+static void
+report(const char *name, int n, uint64_t cycles)
+{
+	cprintf("bench %s %d %llu\n", name, n, cycles / n);
+}
+
+void
+umain(void)
+{
+	uint64_t start, talloc = 0, tmap = 0, tunmap = 0;
+	size_t off;
+	int j, r;
+
+	binaryname = "benchrange";
+
+	for (j = 0; j < NROUNDS; j++) {
+		start = read_tsc();
+		for (off = 0; off < LEN; off += PGSIZE)
+			if ((r = sys_page_alloc(0, SRC + off, PTE_P|PTE_U|PTE_W)) < 0)
+				panic("sys_page_alloc: %e", r);
+		talloc += read_tsc() - start;
+
+		start = read_tsc();
+		for (off = 0; off < LEN; off += PGSIZE)
+			if ((r = sys_page_map(0, SRC + off, 0, DST + off,
+					      PTE_P|PTE_U)) < 0)
+				panic("sys_page_map: %e", r);
+		tmap += read_tsc() - start;
+
+		start = read_tsc();
+		for (off = 0; off < LEN; off += PGSIZE) {
+			sys_page_unmap(0, SRC + off);
+			sys_page_unmap(0, DST + off);
+		}
+		tunmap += read_tsc() - start;
+	}
+	report("pages_alloc_4m", NROUNDS, talloc);
+	report("pages_map_4m", NROUNDS, tmap);
+	report("pages_unmap_4m", NROUNDS, tunmap);
+
+	talloc = tmap = tunmap = 0;
+	for (j = 0; j < NROUNDS; j++) {
+		start = read_tsc();
+		if ((r = sys_page_alloc_range(0, SRC, LEN, PTE_P|PTE_U|PTE_W)) < 0)
+			panic("sys_page_alloc_range: %e", r);
+		talloc += read_tsc() - start;
+
+		start = read_tsc();
+		if ((r = sys_page_map_range(0, SRC, 0, DST, LEN, PTE_P|PTE_U)) < 0)
+			panic("sys_page_map_range: %e", r);
+		tmap += read_tsc() - start;
+
+		// Both mappings must see the same pages.
+		SRC[LEN - 1] = j;
+		if (DST[LEN - 1] != j)
+			panic("range mapping does not share pages");
+
+		start = read_tsc();
+		sys_page_unmap_range(0, SRC, LEN);
+		sys_page_unmap_range(0, DST, LEN);
+		tunmap += read_tsc() - start;
+	}
+	report("range_alloc_4m", NROUNDS, talloc);
+	report("range_map_4m", NROUNDS, tmap);
+	report("range_unmap_4m", NROUNDS, tunmap);
+}
@@ -0,0 +1,72 @@
+// Benchmark the null system call, SYS_getenvid, entered through
+// sysenter as the library does and through int $T_SYSCALL.  The
+// library's sys_getenvid() no longer enters the kernel, so both are
+// open-coded here; it is timed too, for comparison.
+// Results are lines of the form "bench <name> <iterations> <cycles>",
+// with cycles per operation; bench.sh collects them.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define N		100000
+
+static void
+report(const char *name, int n, uint64_t cycles)
+{
+	cprintf("bench %s %d %llu\n", name, n, cycles / n);
+}
+
+static inline envid_t
+getenvid_sysenter(void)
+{
+	envid_t ret;
+
+	// The sysenter sequence from lib/syscall.c, with no arguments.
+	asm volatile("pushl $0\n\t"
+		     "pushl %%ebp\n\t"
+		     "movl %%esp, %%ebp\n\t"
+		     "movl $1f, %%esi\n\t"
+		     "sysenter\n"
+		     "1:\tpopl %%ebp\n\t"
+		     "addl $4, %%esp\n\t"
+		     : "=a" (ret)
+		     : "a" (SYS_getenvid)
+		     : "ecx", "edx", "esi", "cc", "memory");
+	return ret;
+}
+
+static inline envid_t
+getenvid_int(void)
+{
+	envid_t ret;
+
+	asm volatile("int %1"
+		     : "=a" (ret)
+		     : "i" (T_SYSCALL), "a" (SYS_getenvid)
+		     : "cc", "memory");
+	return ret;
+}
+
+void
+umain(void)
+{
+	uint64_t start;
+	int i;
+
+	binaryname = "benchsyscall";
+
+	start = read_tsc();
+	for (i = 0; i < N; i++)
+		getenvid_sysenter();
+	report("syscall_sysenter", N, read_tsc() - start);
+
+	start = read_tsc();
+	for (i = 0; i < N; i++)
+		getenvid_int();
+	report("syscall_int", N, read_tsc() - start);
+
+	start = read_tsc();
+	for (i = 0; i < N; i++)
+		sys_getenvid();
+	report("getenvid_kinfo", N, read_tsc() - start);
+}
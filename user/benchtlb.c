@@ -0,0 +1,75 @@
+// Benchmark how much of the TLB survives a kernel entry: touch a
+// working set of NPAGES pages after each of a cheap sysenter call, a
+// sys_yield that comes straight back to us, and a sys_page_map of a
+// page outside the working set, and compare with touching it alone.
+// Results are lines of the form "bench <name> <iterations> <cycles>",
+// with cycles per operation; bench.sh collects them.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define N		10000
+#define NPAGES		64
+
+#define WSET		((volatile uint8_t *) 0x10000000)
+#define SCRATCH		((void *) 0x20000000)
+
+static void
+report(const char *name, int n, uint64_t cycles)
+{
+	cprintf("bench %s %d %llu\n", name, n, cycles / n);
+}
+
+static void
+touch(void)
+{
+	int i;
+
+	for (i = 0; i < NPAGES; i++)
+		(void) WSET[i * PGSIZE];
+}
+
+void
+umain(void)
+{
+	uint64_t start;
+	int i, r;
+
+	binaryname = "benchtlb";
+
+	for (i = 0; i < NPAGES; i++)
+		if ((r = sys_page_alloc(0, (void *) (WSET + i * PGSIZE),
+					PTE_P|PTE_U|PTE_W)) < 0)
+			panic("sys_page_alloc: %e", r);
+	if ((r = sys_page_alloc(0, SCRATCH, PTE_P|PTE_U|PTE_W)) < 0)
+		panic("sys_page_alloc: %e", r);
+	touch();
+
+	start = read_tsc();
+	for (i = 0; i < N; i++)
+		touch();
+	report("tlb_touch", N, read_tsc() - start);
+
+	start = read_tsc();
+	for (i = 0; i < N; i++) {
+		sys_env_set_pgfault_upcall(0, env->env_pgfault_upcall);
+		touch();
+	}
+	report("tlb_syscall", N, read_tsc() - start);
+
+	start = read_tsc();
+	for (i = 0; i < N; i++) {
+		sys_yield();
+		touch();
+	}
+	report("tlb_yield", N, read_tsc() - start);
+
+	start = read_tsc();
+	for (i = 0; i < N; i++) {
+		if ((r = sys_page_map(0, SCRATCH, 0, SCRATCH,
+				      PTE_P|PTE_U|PTE_W)) < 0)
+			panic("sys_page_map: %e", r);
+		touch();
+	}
+	report("tlb_page_map", N, read_tsc() - start);
+}
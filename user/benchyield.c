@@ -0,0 +1,45 @@
+// Benchmark sys_yield: alone, where the scheduler picks us straight
+// back, and against a child that also yields in a loop, where every
+// call is a round trip through the child.
+// Results are lines of the form "bench <name> <iterations> <cycles>",
+// with cycles per operation; bench.sh collects them.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define N		20000
+
+static void
+report(const char *name, int n, uint64_t cycles)
+{
+	cprintf("bench %s %d %llu\n", name, n, cycles / n);
+}
+
+void
+umain(void)
+{
+	uint64_t start;
+	envid_t kid;
+	int i;
+
+	binaryname = "benchyield";
+
+	start = read_tsc();
+	for (i = 0; i < N; i++)
+		sys_yield();
+	report("yield_alone", N, read_tsc() - start);
+
+	if ((kid = fork()) < 0)
+		panic("fork: %e", kid);
+	if (kid == 0)
+		while (1)
+			sys_yield();
+	// Let the child start yielding before starting the clock.
+	sys_yield();
+
+	start = read_tsc();
+	for (i = 0; i < N; i++)
+		sys_yield();
+	report("yield_roundtrip", N, read_tsc() - start);
+	sys_env_destroy(kid);
+}
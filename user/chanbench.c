@@ -0,0 +1,73 @@
+// Throughput of a stream of small messages from a child to its parent,
+// first with ipc_send as user/pingpong does, then through a channel.
+// Report cycles and system calls per message for both: each ipc_send
+// is a rendezvous costing a send, a receive and a context switch, while
+// the channel should only need the kernel when the ring runs empty or
+// full.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NIPC		10000
+#define NCHAN		100000
+
+#define CHAN		((struct Chan *) 0x10000000)
+
+static void
+report(const char *what, int n, uint64_t cycles, uint32_t syscalls)
+{
+	cprintf("chanbench: %s: %d messages, %llu cycles and %u.%02u "
+		"syscalls per message\n", what, n, cycles / n,
+		syscalls / n, syscalls * 100 / n % 100);
+}
+
+// Syscalls made by us and 'kid' since the counts in s0.
+static uint32_t
+syscalls(envid_t kid, uint32_t s0)
+{
+	return env->env_syscalls + envs[ENVX(kid)].env_syscalls - s0;
+}
+
+void
+umain(void)
+{
+	envid_t kid, who;
+	uint64_t start;
+	uint32_t s0, v;
+	int i, r;
+
+	binaryname = "chanbench";
+
+	if ((kid = fork()) < 0)
+		panic("fork: %e", kid);
+	if (kid == 0) {
+		ipc_recv(&who, 0, 0);
+		for (i = 0; i < NIPC; i++)
+			ipc_send(who, i, 0, 0);
+		ipc_recv(&who, 0, 0);
+		for (i = 0; i < NCHAN; i++)
+			chan_send(CHAN, i);
+		// Stay around until our counters have been read.
+		ipc_recv(&who, 0, 0);
+		return;
+	}
+
+	s0 = env->env_syscalls + envs[ENVX(kid)].env_syscalls;
+	start = read_tsc();
+	ipc_send(kid, 0, 0, 0);
+	for (i = 0; i < NIPC; i++)
+		if ((v = ipc_recv(&who, 0, 0)) != i)
+			panic("ipc: got %u, expected %u", v, i);
+	report("ipc_send", NIPC, read_tsc() - start, syscalls(kid, s0));
+
+	if ((r = chan_create(CHAN, kid, env->env_id)) < 0)
+		panic("chan_create: %e", r);
+	s0 = env->env_syscalls + envs[ENVX(kid)].env_syscalls;
+	start = read_tsc();
+	ipc_send(kid, 0, 0, 0);
+	for (i = 0; i < NCHAN; i++)
+		if ((v = chan_recv(CHAN)) != i)
+			panic("chan: got %u, expected %u", v, i);
+	report("chan", NCHAN, read_tsc() - start, syscalls(kid, s0));
+	ipc_send(kid, 0, 0, 0);
+}
@@ -0,0 +1,91 @@
+// Deadline misses of a periodic job under load, with and without a
+// reservation.  NSPIN children spin like the child of user/spin.c,
+// pinned to the top band.  We run a job of about half a tick of work
+// every PERIOD ticks and count the jobs that finish more than PERIOD
+// ticks after their release, first as a best-effort env and then with
+// BUDGET ticks of every PERIOD reserved by sys_env_set_reservation.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NSPIN		6
+#define NJOBS		40
+#define PERIOD		5
+#define BUDGET		2
+#define CALIB		(1 << 20)
+
+static volatile uint32_t counter;
+
+static void
+work(uint32_t iters)
+{
+	uint32_t i;
+
+	for (i = 0; i < iters; i++)
+		counter++;
+}
+
+// Run NJOBS jobs and return how many missed their deadline.
+static int
+run_jobs(uint32_t iters, uint64_t period)
+{
+	uint64_t release, finish;
+	int i, misses = 0;
+
+	release = read_tsc();
+	for (i = 0; i < NJOBS; i++) {
+		work(iters);
+		finish = read_tsc();
+		if (finish - release > period)
+			misses++;
+		sys_sleep(PERIOD);
+		release = finish + period;
+	}
+	return misses;
+}
+
+void
+umain(void)
+{
+	envid_t kids[NSPIN];
+	uint64_t start, tick, calib;
+	uint32_t iters;
+	int i, r, best_effort, reserved;
+
+	binaryname = "edf";
+
+	// Calibrate against the clock while nothing else runs.
+	start = read_tsc();
+	sys_sleep(20);
+	tick = (read_tsc() - start) / 20;
+	start = read_tsc();
+	work(CALIB);
+	calib = read_tsc() - start;
+	iters = (uint64_t) CALIB * (tick / 2) / calib;
+
+	for (i = 0; i < NSPIN; i++) {
+		if ((kids[i] = fork()) < 0)
+			panic("fork: %e", kids[i]);
+		if (kids[i] == 0)
+			while (1)
+				/* do nothing */;
+		if ((r = sys_env_set_priority(kids[i], 0)) < 0)
+			panic("sys_env_set_priority: %e", r);
+	}
+
+	best_effort = run_jobs(iters, PERIOD * tick);
+	if ((r = sys_env_set_reservation(0, BUDGET, PERIOD)) < 0)
+		panic("sys_env_set_reservation: %e", r);
+	reserved = run_jobs(iters, PERIOD * tick);
+	sys_env_set_reservation(0, 0, 0);
+
+	for (i = 0; i < NSPIN; i++)
+		sys_env_destroy(kids[i]);
+
+	cprintf("edf: %d spinners, %d jobs every %d ticks: "
+		"%d missed best-effort, %d missed with %d/%d reserved\n",
+		NSPIN, NJOBS, PERIOD, best_effort, reserved, BUDGET, PERIOD);
+	if (reserved)
+		panic("reserved job missed %d deadlines", reserved);
+	cprintf("edf: OK\n");
+}
@@ -0,0 +1,85 @@
+// Test IPC endpoints: NWORKER workers serve one endpoint.  While one
+// of them is busy with a slow request, as a file server worker would
+// be waiting on the disk, the others keep answering fast ones.
+
+#include <inc/lib.h>
+
+#define EP		1
+#define NWORKER		3
+#define NCALL		20
+#define SLOW		1
+#define FAST		2
+#define SLOW_TICKS	50
+
+static void
+worker(int i)
+{
+	struct Ipc_msg reply;
+	envid_t whom;
+	int32_t req;
+	int r;
+
+	if ((r = sys_ep_bind(EP)) < 0)
+		panic("sys_ep_bind: %e", r);
+	memset(&reply, 0, sizeof(reply));
+	reply.im_regs[0] = i;
+	req = ipc_reply_recv(0, 0, &whom, 0, 0, 0);
+	while (1) {
+		if (req == SLOW)
+			sys_sleep(SLOW_TICKS);
+		req = ipc_reply_recv(whom, &reply, &whom, 0, 0, 0);
+	}
+}
+
+static int32_t
+call(uint32_t req)
+{
+	struct Ipc_msg m;
+	int32_t r;
+
+	memset(&m, 0, sizeof(m));
+	m.im_regs[0] = req;
+	if ((r = ipc_call_ep(EP, &m, 0, 0)) < 0)
+		panic("ipc_call_ep: %e", r);
+	return r;
+}
+
+void
+umain(void)
+{
+	envid_t kids[NWORKER], slow;
+	uint32_t served = 0;
+	int i, r;
+
+	binaryname = "eppool";
+
+	if ((r = sys_ep_create(EP)) < 0)
+		panic("sys_ep_create: %e", r);
+	for (i = 0; i < NWORKER; i++) {
+		if ((kids[i] = fork()) < 0)
+			panic("fork: %e", kids[i]);
+		if (kids[i] == 0)
+			worker(i);
+	}
+
+	if ((slow = fork()) < 0)
+		panic("fork: %e", slow);
+	if (slow == 0) {
+		call(SLOW);
+		sys_notify(env->env_parent_id, 1);
+		return;
+	}
+
+	// Let the slow call reach a worker, then make fast ones.
+	sys_sleep(5);
+	for (i = 0; i < NCALL; i++)
+		served |= 1 << call(FAST);
+	if (env->env_notify_pending & 1)
+		panic("fast calls waited for the slow one");
+	sys_wait_notify(1);
+
+	for (i = 0; i < NWORKER; i++)
+		sys_env_destroy(kids[i]);
+	cprintf("eppool: workers used for fast calls: %x\n", served);
+	cprintf("eppool: OK\n");
+}
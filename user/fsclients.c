@@ -0,0 +1,60 @@
+// Throughput of NCLIENT environments hammering the file server at
+// once.  Each client opens and closes /motd NOPEN times.  Besides the
+// time per request, report how many system calls the clients made per
+// request: a client that spins retrying its send while the server is
+// busy makes many, one that blocks in the kernel makes few.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NCLIENT		4
+#define NOPEN		50
+
+static void
+client(void)
+{
+	envid_t parent;
+	uint32_t syscalls;
+	int i, fd;
+
+	ipc_recv(&parent, 0, 0);
+	syscalls = env->env_syscalls;
+	for (i = 0; i < NOPEN; i++) {
+		if ((fd = open("/motd", O_RDONLY)) < 0)
+			panic("open /motd: %e", fd);
+		close(fd);
+	}
+	ipc_send(parent, env->env_syscalls - syscalls, 0, 0);
+}
+
+void
+umain(void)
+{
+	envid_t kids[NCLIENT], who;
+	uint64_t start, cycles;
+	uint32_t syscalls;
+	int i;
+
+	binaryname = "fsclients";
+
+	for (i = 0; i < NCLIENT; i++) {
+		if ((kids[i] = fork()) < 0)
+			panic("fork: %e", kids[i]);
+		if (kids[i] == 0) {
+			client();
+			return;
+		}
+	}
+
+	start = read_tsc();
+	for (i = 0; i < NCLIENT; i++)
+		ipc_send(kids[i], 0, 0, 0);
+	syscalls = 0;
+	for (i = 0; i < NCLIENT; i++)
+		syscalls += ipc_recv(&who, 0, 0);
+	cycles = read_tsc() - start;
+
+	cprintf("fsclients: %d clients, %llu cycles per open+close, "
+		"%u syscalls per open+close\n", NCLIENT,
+		cycles / (NCLIENT * NOPEN), syscalls / (NCLIENT * NOPEN));
+}
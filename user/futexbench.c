@@ -0,0 +1,125 @@
+// Contention benchmark for the futex-based mutex in lib/sync.c.
+// NKID children hammer a counter on one shared page, each mapping the
+// page at a different address, under a mutex and then under a lock
+// that spins with sys_yield.  Report cycles and system calls per
+// critical section for both, and check that no increment was lost.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NKID		4
+#define NITER		20000
+
+#define SHARED		0x10000000
+#define KIDSHARED(i)	((struct shared *) (SHARED + ((i) + 1) * PGSIZE))
+
+struct shared {
+	struct Mutex mu;
+	volatile uint32_t spin;
+	volatile uint32_t counter;
+};
+
+enum { MUTEX, SPIN };
+
+static void
+spin_lock(volatile uint32_t *l)
+{
+	while (xchg(l, 1) != 0)
+		sys_yield();
+}
+
+static void
+spin_unlock(volatile uint32_t *l)
+{
+	xchg(l, 0);
+}
+
+static void
+kid(struct shared *sh)
+{
+	envid_t who;
+	int i, kind;
+
+	while ((kind = ipc_recv(&who, 0, 0)) >= 0) {
+		for (i = 0; i < NITER; i++) {
+			if (kind == MUTEX) {
+				mutex_lock(&sh->mu);
+				sh->counter++;
+				mutex_unlock(&sh->mu);
+			} else {
+				spin_lock(&sh->spin);
+				sh->counter++;
+				spin_unlock(&sh->spin);
+			}
+		}
+		ipc_send(who, 0, 0, 0);
+	}
+}
+
+static uint32_t
+kid_syscalls(envid_t *kids)
+{
+	uint32_t n = 0;
+	int i;
+
+	for (i = 0; i < NKID; i++)
+		n += envs[ENVX(kids[i])].env_syscalls;
+	return n;
+}
+
+static void
+run(const char *what, int kind, struct shared *sh, envid_t *kids)
+{
+	uint64_t start, cycles;
+	uint32_t s0, syscalls;
+	int i, n = NKID * NITER;
+
+	sh->counter = 0;
+	s0 = kid_syscalls(kids);
+	start = read_tsc();
+	for (i = 0; i < NKID; i++)
+		ipc_send(kids[i], kind, 0, 0);
+	for (i = 0; i < NKID; i++)
+		ipc_recv(0, 0, 0);
+	cycles = read_tsc() - start;
+	// Each kid's final ipc_send is not part of the lock traffic.
+	syscalls = kid_syscalls(kids) - s0 - NKID;
+
+	if (sh->counter != n)
+		panic("%s: counter %u, expected %u", what, sh->counter, n);
+	cprintf("futexbench: %s: %d kids x %d, %llu cycles and %u.%02u "
+		"syscalls per lock\n", what, NKID, NITER, cycles / n,
+		syscalls / n, syscalls * 100 / n % 100);
+}
+
+void
+umain(void)
+{
+	struct shared *sh = (struct shared *) SHARED;
+	envid_t kids[NKID];
+	int i, r;
+
+	binaryname = "futexbench";
+
+	for (i = 0; i < NKID; i++) {
+		if ((kids[i] = fork()) < 0)
+			panic("fork: %e", kids[i]);
+		if (kids[i] == 0) {
+			kid(KIDSHARED(i));
+			return;
+		}
+	}
+
+	if ((r = sys_page_alloc(0, sh, PTE_P|PTE_U|PTE_W)) < 0)
+		panic("sys_page_alloc: %e", r);
+	mutex_init(&sh->mu);
+	for (i = 0; i < NKID; i++)
+		if ((r = sys_page_map(0, sh, kids[i], KIDSHARED(i),
+				      PTE_P|PTE_U|PTE_W)) < 0)
+			panic("sys_page_map: %e", r);
+
+	run("mutex", MUTEX, sh, kids);
+	run("spin+yield", SPIN, sh, kids);
+	for (i = 0; i < NKID; i++)
+		sys_env_destroy(kids[i]);
+}
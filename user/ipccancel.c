@@ -0,0 +1,78 @@
+// Test that suspending and resuming an env blocked in IPC cancels the
+// IPC cleanly.  A child calls an endpoint nobody serves yet, then its
+// parent without getting a reply; each time the parent suspends and
+// resumes it, so the call fails, and the child calls again.  A leftover
+// queue entry would corrupt the kernel's queues on the next call.
+
+#include <inc/lib.h>
+
+#define EP		2
+#define REPLY		42
+
+static void
+kid(envid_t parent)
+{
+	struct Ipc_msg m;
+	int32_t r;
+
+	memset(&m, 0, sizeof(m));
+	if ((r = ipc_call_ep(EP, &m, 0, 0)) != -E_IPC_NOT_RECV)
+		panic("queued endpoint call: got %e", r);
+	if ((r = ipc_call(parent, &m, 0, 0)) != -E_IPC_NOT_RECV)
+		panic("call waiting for a reply: got %e", r);
+	if ((r = ipc_call_ep(EP, &m, 0, 0)) != REPLY)
+		panic("endpoint call after the others: got %e", r);
+	sys_notify(parent, 1);
+}
+
+// Wait for envid to block, then suspend and resume it.
+static void
+suspend_resume(envid_t envid)
+{
+	int r;
+
+	while (envs[ENVX(envid)].env_status != ENV_NOT_RUNNABLE)
+		sys_yield();
+	if ((r = sys_env_set_status(envid, ENV_NOT_RUNNABLE)) < 0 ||
+	    (r = sys_env_set_status(envid, ENV_RUNNABLE)) < 0)
+		panic("sys_env_set_status: %e", r);
+}
+
+void
+umain(void)
+{
+	struct Ipc_msg reply;
+	envid_t who, parent = sys_getenvid();
+	int32_t r;
+
+	binaryname = "ipccancel";
+
+	if ((r = sys_ep_create(EP)) < 0)
+		panic("sys_ep_create: %e", r);
+	if ((who = fork()) < 0)
+		panic("fork: %e", who);
+	if (who == 0) {
+		kid(parent);
+		return;
+	}
+
+	// The kid is queued on the endpoint, which has no worker.
+	suspend_resume(who);
+	cprintf("ipccancel: cancelled a queued endpoint call\n");
+
+	// Take its call but don't reply.
+	ipc_recv(0, 0, 0);
+	suspend_resume(who);
+	cprintf("ipccancel: cancelled a call waiting for a reply\n");
+
+	// Serve its last call.
+	if ((r = sys_ep_bind(EP)) < 0)
+		panic("sys_ep_bind: %e", r);
+	ipc_reply_recv(0, 0, &who, 0, 0, 0);
+	memset(&reply, 0, sizeof(reply));
+	reply.im_regs[0] = REPLY;
+	if ((r = ipc_reply_recv(who, &reply, 0, 0, 0, 1)) != -E_TIMEOUT)
+		panic("ipc_reply_recv: got %e", r);
+	sys_wait_notify(1);
+	cprintf("ipccancel: OK\n");
+}
@@ -0,0 +1,64 @@
+// Measure IPC round-trip latency, in TSC cycles: a ping-pong between
+// two environments, and opening a file through the file server.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NPINGPONG	1000
+#define NOPEN		100
+
+static void
+pingpong(void)
+{
+	envid_t who, child;
+	uint64_t start;
+	int i;
+
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		while (1) {
+			i = ipc_recv(&who, 0, 0);
+			ipc_send(who, i, 0, 0);
+		}
+	}
+
+	// Make sure the child is waiting before starting the clock.
+	ipc_send(child, 0, 0, 0);
+	ipc_recv(&who, 0, 0);
+
+	start = read_tsc();
+	for (i = 0; i < NPINGPONG; i++) {
+		ipc_send(child, i, 0, 0);
+		ipc_recv(&who, 0, 0);
+	}
+	cprintf("ipclat: pingpong %llu cycles per round trip\n",
+		(read_tsc() - start) / NPINGPONG);
+	sys_env_destroy(child);
+}
+
+static void
+openclose(void)
+{
+	uint64_t start, cycles;
+	int i, fd;
+
+	cycles = 0;
+	for (i = 0; i < NOPEN; i++) {
+		start = read_tsc();
+		if ((fd = open("/motd", O_RDONLY)) < 0)
+			panic("open /motd: %e", fd);
+		cycles += read_tsc() - start;
+		close(fd);
+	}
+	cprintf("ipclat: open %llu cycles per call\n", cycles / NOPEN);
+}
+
+void
+umain(void)
+{
+	binaryname = "ipclat";
+
+	pingpong();
+	openclose();
+}
@@ -0,0 +1,74 @@
+// Test sys_ipc_sendv and sys_ipc_recvv: a child sends its parent
+// message registers and NPAGES pages in one message, first shared
+// and then donated.  A donated page is no longer mapped in the child.
+
+#include <inc/lib.h>
+
+#define NPAGES		3
+#define SRCVA		((char *) 0x10000000)
+#define DSTVA		((char *) 0x20000000)
+
+static void
+child(envid_t parent, unsigned flags)
+{
+	struct Ipc_msg m;
+	int i, r;
+
+	memset(&m, 0, sizeof(m));
+	for (i = 0; i < NPAGES; i++) {
+		if ((r = sys_page_alloc(0, SRCVA + i * PGSIZE, PTE_P|PTE_U|PTE_W)) < 0)
+			panic("sys_page_alloc: %e", r);
+		snprintf(SRCVA + i * PGSIZE, PGSIZE, "page %d", i);
+		m.im_pages[i] = SRCVA + i * PGSIZE;
+	}
+	for (i = 0; i < IPC_NREGS; i++)
+		m.im_regs[i] = 100 + i;
+	m.im_npages = NPAGES;
+	m.im_perm = PTE_P|PTE_U|PTE_W;
+	m.im_flags = flags;
+	if ((r = ipc_sendv(parent, &m)) != NPAGES)
+		panic("ipc_sendv returned %e, not %d", r, NPAGES);
+	for (i = 0; i < NPAGES; i++)
+		if ((flags & IPC_DONATE) && (vpd[PDX(SRCVA)] & PTE_P) &&
+		    (vpt[VPN(SRCVA + i * PGSIZE)] & PTE_P))
+			panic("donated page %d is still mapped", i);
+}
+
+static void
+check(unsigned flags)
+{
+	uint32_t regs[IPC_NREGS];
+	char want[16];
+	envid_t kid, who;
+	int i, r;
+
+	if ((kid = fork()) < 0)
+		panic("fork: %e", kid);
+	if (kid == 0) {
+		child(env->env_parent_id, flags);
+		exit();
+	}
+
+	// Ask for one page more than is sent.
+	if ((r = ipc_recvv(&who, DSTVA, NPAGES + 1, regs)) != NPAGES)
+		panic("ipc_recvv returned %e, not %d", r, NPAGES);
+	for (i = 0; i < IPC_NREGS; i++)
+		if (regs[i] != 100 + i)
+			panic("register %d is %u", i, regs[i]);
+	for (i = 0; i < NPAGES; i++) {
+		snprintf(want, sizeof(want), "page %d", i);
+		if (strcmp(DSTVA + i * PGSIZE, want) != 0)
+			panic("page %d holds '%s'", i, DSTVA + i * PGSIZE);
+		sys_page_unmap(0, DSTVA + i * PGSIZE);
+	}
+}
+
+void
+umain(void)
+{
+	binaryname = "ipcvec";
+
+	check(0);
+	check(IPC_DONATE);
+	cprintf("ipcvec: OK\n");
+}
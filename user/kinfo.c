@@ -0,0 +1,36 @@
+// Read the kernel's Kinfo and Envinfo pages, in a parent and in a
+// forked child, and check them against what the kernel says.
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	uint32_t t0;
+	envid_t who;
+
+	binaryname = "kinfo";
+
+	cprintf("kinfo: %u Hz, TSC %llu kHz, %u pages free\n",
+		kinfo.ki_hz, kinfo.ki_tsc_freq / 1000, kinfo.ki_free_pages);
+	if (envinfo.ei_envid != env->env_id)
+		panic("envinfo says %08x, envs says %08x",
+		      envinfo.ei_envid, env->env_id);
+
+	t0 = time_ticks();
+	sys_sleep(10);
+	if (time_ticks() - t0 < 10)
+		panic("slept %u ticks, wanted 10", time_ticks() - t0);
+
+	if ((who = fork()) < 0)
+		panic("fork: %e", who);
+	if (who == 0) {
+		if (envinfo.ei_envid == env->env_parent_id ||
+		    envinfo.ei_envid != env->env_id)
+			panic("child sees envid %08x", envinfo.ei_envid);
+		cprintf("kinfo: child %08x ok\n", envinfo.ei_envid);
+		return;
+	}
+	cprintf("kinfo: parent %08x ok, at tick %u\n", envinfo.ei_envid,
+		time_ticks());
+}
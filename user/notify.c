@@ -0,0 +1,40 @@
+// Test sys_notify and sys_wait_notify.
+
+#include <inc/lib.h>
+
+void
+umain(void)
+{
+	envid_t kid;
+	uint32_t bits;
+	int r;
+
+	binaryname = "notify";
+
+	// Bits already pending are taken without blocking, and only those
+	// in the mask.
+	if ((r = sys_notify(0, 0x5)) < 0)
+		panic("sys_notify: %e", r);
+	if ((bits = sys_wait_notify(0x4)) != 0x4)
+		panic("sys_wait_notify took %x, not 4", bits);
+	if ((bits = sys_wait_notify(0x3)) != 0x1)
+		panic("sys_wait_notify took %x, not 1", bits);
+
+	// A child notifies us with bits we don't wait for, then with one
+	// we do; the first stay pending.
+	if ((kid = fork()) < 0)
+		panic("fork: %e", kid);
+	if (kid == 0) {
+		sys_sleep(5);
+		sys_notify(env->env_parent_id, 0x10);
+		sys_notify(env->env_parent_id, 0x10);
+		sys_notify(env->env_parent_id, 0x2);
+		return;
+	}
+	if ((bits = sys_wait_notify(0x2)) != 0x2)
+		panic("sys_wait_notify took %x, not 2", bits);
+	if ((bits = sys_wait_notify(0x10)) != 0x10)
+		panic("sys_wait_notify took %x, not 10", bits);
+
+	cprintf("notify: OK\n");
+}
@@ -6,7 +6,7 @@
 //
 // Since NENVS is 1024, we can print 1022 primes before running out.
 // The remaining two environments are the integer generator at the bottom
-// of main and user/idle.
+// of main and the file server.
 
 #include <inc/lib.h>
 
@@ -0,0 +1,96 @@
+// Test named shared-memory segments.  A parent and a child that each
+// attach a segment by key, at different addresses, see each other's
+// writes; the segment goes away on the last detach, and a segment
+// goes away with the env that created it.  A segment attached with
+// PTE_SHARE before fork is shared with the child, whose detach of the
+// inherited mapping does not destroy it.
+
+#include <inc/lib.h>
+
+#define KEY		0x53484d31	// "SHM1"
+#define KEY2		0x53484d32
+#define KEY3		0x53484d33
+#define NPAGES		16
+#define VA		((uint32_t *) 0x10000000)
+#define KIDVA		((uint32_t *) 0x20000000)
+#define NWORDS		(NPAGES * PGSIZE / sizeof(uint32_t))
+
+void
+umain(void)
+{
+	envid_t kid, who;
+	uint32_t sum;
+	int i, r;
+
+	binaryname = "shm";
+
+	if ((kid = fork()) < 0)
+		panic("fork: %e", kid);
+	if (kid == 0) {
+		ipc_recv(&who, 0, 0);
+		if ((r = sys_shm_attach(KEY, KIDVA, PTE_P|PTE_U|PTE_W)) != NPAGES)
+			panic("kid: sys_shm_attach: %e", r);
+		for (sum = i = 0; i < NWORDS; i++)
+			sum += KIDVA[i];
+		KIDVA[0] = sum;
+		sys_shm_detach(KIDVA);
+
+		// Create a segment and exit without destroying it.
+		if ((r = sys_shm_create(KEY2, 1)) < 0)
+			panic("kid: sys_shm_create: %e", r);
+		ipc_send(who, 0, 0, 0);
+		return;
+	}
+
+	if ((r = sys_shm_create(KEY, NPAGES)) < 0)
+		panic("sys_shm_create: %e", r);
+	if ((r = sys_shm_create(KEY, 1)) != -E_INVAL)
+		panic("sys_shm_create of a taken key: got %e", r);
+	if ((r = sys_shm_attach(KEY, VA, PTE_P|PTE_U|PTE_W)) != NPAGES)
+		panic("sys_shm_attach: %e", r);
+	for (sum = i = 0; i < NWORDS; i++)
+		sum += (VA[i] = i);
+
+	ipc_send(kid, 0, 0, 0);
+	ipc_recv(0, 0, 0);
+	if (VA[0] != sum)
+		panic("kid saw sum %u, expected %u", VA[0], sum);
+	cprintf("shm: child saw the parent's writes\n");
+
+	sys_shm_detach(VA);
+	if ((r = sys_shm_attach(KEY, VA, PTE_P|PTE_U)) != -E_NOT_FOUND)
+		panic("segment survived its last detach: %e", r);
+	cprintf("shm: last detach destroyed the segment\n");
+
+	// The child may not have been freed yet.
+	while (envs[ENVX(kid)].env_id == kid &&
+	       envs[ENVX(kid)].env_status != ENV_FREE)
+		sys_yield();
+	if ((r = sys_shm_attach(KEY2, VA, PTE_P|PTE_U)) != -E_NOT_FOUND)
+		panic("segment survived its owner: %e", r);
+	cprintf("shm: owner exit destroyed the segment\n");
+
+	if ((r = sys_shm_create(KEY3, 1)) < 0)
+		panic("sys_shm_create: %e", r);
+	if ((r = sys_shm_attach(KEY3, VA, PTE_P|PTE_U|PTE_W|PTE_SHARE)) != 1)
+		panic("sys_shm_attach: %e", r);
+	VA[0] = 0;
+	if ((kid = fork()) < 0)
+		panic("fork: %e", kid);
+	if (kid == 0) {
+		VA[0] = 1;
+		sys_shm_detach(VA);
+		ipc_send(env->env_parent_id, 0, 0, 0);
+		return;
+	}
+	ipc_recv(0, 0, 0);
+	if (VA[0] != 1)
+		panic("the child's write to a PTE_SHARE segment was not shared");
+	if ((r = sys_shm_attach(KEY3, KIDVA, PTE_P|PTE_U)) != 1)
+		panic("segment did not survive the child's detach: %e", r);
+	cprintf("shm: PTE_SHARE segment stays shared across fork\n");
+	sys_shm_detach(KIDVA);
+	sys_shm_detach(VA);
+	if ((r = sys_shm_attach(KEY3, VA, PTE_P|PTE_U)) != -E_NOT_FOUND)
+		panic("segment survived its last detach: %e", r);
+}
@@ -0,0 +1,43 @@
+// Test sys_sleep and ipc_recv_timeout.  Ticks are 10ms, see KCLOCK_HZ.
+
+#include <inc/lib.h>
+#include <inc/x86.h>
+
+#define NTICKS		50
+
+void
+umain(void)
+{
+	envid_t who, child;
+	uint64_t start, cycles;
+	int r;
+
+	binaryname = "sleep";
+
+	start = read_tsc();
+	if ((r = sys_sleep(NTICKS)) < 0)
+		panic("sys_sleep: %e", r);
+	cycles = read_tsc() - start;
+	cprintf("slept %d ticks in %llu cycles\n", NTICKS, cycles);
+
+	// Nobody sends to us, so this times out.
+	start = read_tsc();
+	r = ipc_recv_timeout(&who, 0, 0, NTICKS);
+	if (r != -E_TIMEOUT)
+		panic("ipc_recv_timeout returned %e, not timeout", r);
+	cprintf("ipc_recv timed out after %d ticks in %llu cycles\n", NTICKS,
+		read_tsc() - start);
+
+	// A message that arrives in time cancels the timeout.
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		sys_sleep(NTICKS / 5);
+		ipc_send(env->env_parent_id, 42, 0, 0);
+		return;
+	}
+	if ((r = ipc_recv_timeout(&who, 0, 0, NTICKS)) != 42)
+		panic("ipc_recv_timeout returned %e, not 42", r);
+
+	cprintf("sleep: OK\n");
+}
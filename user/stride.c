@@ -0,0 +1,113 @@
+// Check that the stride scheduler divides the CPU in proportion to
+// tickets.  Fork NCHILD spinning children with different ticket counts
+// and compare the share of timer ticks (env_runs; each stride run is
+// one tick) and of loop iterations (a proxy for CPU time) each got
+// against its share of the tickets.
+
+#include <inc/lib.h>
+
+#define NCHILD		3
+#define NTICKS		300	// Run the children for about 3 seconds
+#define TOLERANCE	50	// Allowed error, in tenths of a percent
+
+// Loop counters, one per child, on a page shared with the children.
+#define COUNTERS	((volatile uint32_t *) 0x10000000)
+
+static const uint32_t tickets[NCHILD] = { 100, 200, 300 };
+
+static void
+child(int i)
+{
+	envid_t who;
+
+	ipc_recv(&who, 0, 0);
+	while (1)
+		COUNTERS[i]++;
+}
+
+static uint32_t
+runs(envid_t id)
+{
+	return envs[ENVX(id)].env_runs;
+}
+
+// Parts per thousand, and how far off they are from what we expect.
+static int
+check(const char *what, uint32_t got, uint32_t total, uint32_t want)
+{
+	int share = (uint64_t) got * 1000 / total;
+	int err = share - (int) want;
+
+	cprintf("    %s %u (%d.%d%%)", what, got, share / 10, share % 10);
+	return err >= -TOLERANCE && err <= TOLERANCE;
+}
+
+void
+umain(void)
+{
+	envid_t kids[NCHILD];
+	uint32_t runs0[NCHILD], r[NCHILD], n[NCHILD];
+	uint32_t alltickets, allruns, alliters, want;
+	int i, r0, ok;
+
+	alltickets = 0;
+	for (i = 0; i < NCHILD; i++) {
+		alltickets += tickets[i];
+		if ((kids[i] = fork()) < 0)
+			panic("fork: %e", kids[i]);
+		if (kids[i] == 0)
+			child(i);
+	}
+
+	// The counters page is allocated after fork, so it is not
+	// copy-on-write: the children see our page.
+	if ((r0 = sys_page_alloc(0, (void *) COUNTERS, PTE_P|PTE_U|PTE_W)) < 0)
+		panic("sys_page_alloc: %e", r0);
+	for (i = 0; i < NCHILD; i++) {
+		while (!envs[ENVX(kids[i])].env_ipc_recving)
+			sys_yield();
+		if ((r0 = sys_page_map(0, (void *) COUNTERS, kids[i],
+				       (void *) COUNTERS, PTE_P|PTE_U|PTE_W)) < 0)
+			panic("sys_page_map: %e", r0);
+		if ((r0 = sys_env_set_tickets(kids[i], tickets[i])) < 0)
+			panic("sys_env_set_tickets: %e", r0);
+		runs0[i] = runs(kids[i]);
+	}
+
+	// Join the stride class ourselves, with a small share, so that we
+	// get to watch without preempting the children.
+	sys_env_set_tickets(0, 10);
+	for (i = 0; i < NCHILD; i++)
+		ipc_send(kids[i], 0, 0, 0);
+
+	do {
+		sys_yield();
+		allruns = 0;
+		for (i = 0; i < NCHILD; i++)
+			allruns += runs(kids[i]) - runs0[i];
+	} while (allruns < NTICKS);
+
+	// Stop the children before reading their results, so that a timer
+	// tick while we read doesn't skew them.  A freed Env keeps its
+	// env_runs until the slot is reused.
+	for (i = 0; i < NCHILD; i++)
+		sys_env_destroy(kids[i]);
+	allruns = alliters = 0;
+	for (i = 0; i < NCHILD; i++) {
+		r[i] = runs(kids[i]) - runs0[i];
+		n[i] = COUNTERS[i];
+		allruns += r[i];
+		alliters += n[i];
+	}
+
+	ok = 1;
+	for (i = 0; i < NCHILD; i++) {
+		want = tickets[i] * 1000 / alltickets;
+		cprintf("child %d: tickets %u (%d.%d%%)\n", i, tickets[i],
+			want / 10, want % 10);
+		ok &= check("runs", r[i], allruns, want);
+		ok &= check("iterations", n[i], alliters, want);
+		cprintf("\n");
+	}
+	cprintf("stride: %s\n", ok ? "OK" : "FAILED");
+}
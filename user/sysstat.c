@@ -0,0 +1,30 @@
+// Print the kernel's per-syscall statistics, like the kernel monitor's
+// syscalls command, but from user space and by syscall number.  The
+// counters are read from the read-only mapping at USYSSTATS, and our
+// own per-syscall counts from envs[].
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	uint64_t count, timed;
+	int i, b;
+
+	binaryname = "sysstat";
+
+	cprintf("NUM      CALLS     AVG(cyc)   MINE  HISTOGRAM (log2 cycles:calls)\n");
+	for (i = 0; i < NSYSCALLS; i++) {
+		if ((count = syscall_stats.ss_count[i]) == 0)
+			continue;
+		for (timed = 0, b = 0; b < NSYSHIST; b++)
+			timed += syscall_stats.ss_hist[i][b];
+		cprintf("%3d %10llu %12llu %6u ", i, count,
+			timed ? syscall_stats.ss_cycles[i] / timed : 0,
+			env->env_syscall_count[i]);
+		for (b = 0; b < NSYSHIST; b++)
+			if (syscall_stats.ss_hist[i][b])
+				cprintf(" %d:%u", b, syscall_stats.ss_hist[i][b]);
+		cprintf("\n");
+	}
+}
@@ -0,0 +1,59 @@
+// List environments by CPU time used, like the kernel monitor's top
+// command, but from user space.  The counters are read straight from
+// the read-only envs[] mapping at UENVS; taking the snapshot makes no
+// system calls, only printing it does.
+
+#include <inc/lib.h>
+
+struct snapshot {
+	envid_t id;
+	unsigned status;
+	uint32_t runs, syscalls, traps, pgfaults;
+	uint64_t user, kern;
+};
+
+static struct snapshot snap[NENV];
+
+void
+umain(void)
+{
+	struct snapshot s;
+	uint64_t total;
+	unsigned permille;
+	int i, j, n;
+
+	binaryname = "top";
+
+	n = 0;
+	total = 0;
+	for (i = 0; i < NENV; i++) {
+		if (envs[i].env_status == ENV_FREE)
+			continue;
+		s.id = envs[i].env_id;
+		s.status = envs[i].env_status;
+		s.runs = envs[i].env_runs;
+		s.syscalls = envs[i].env_syscalls;
+		s.traps = envs[i].env_traps;
+		s.pgfaults = envs[i].env_pgfaults;
+		s.user = envs[i].env_user_cycles;
+		s.kern = envs[i].env_kern_cycles;
+		total += s.user + s.kern;
+
+		// Insertion sort by CPU time, most first.
+		for (j = n++; j > 0 && snap[j-1].user + snap[j-1].kern < s.user + s.kern; j--)
+			snap[j] = snap[j-1];
+		snap[j] = s;
+	}
+
+	cprintf("ENVID    STATUS       RUNS SYSCALLS    TRAPS  PGFLTS "
+		"  USER(Mcyc)   KERN(Mcyc)   %%CPU\n");
+	for (i = 0; i < n; i++) {
+		permille = total ? (snap[i].user + snap[i].kern) * 1000 / total : 0;
+		cprintf("%08x %-8s %8u %8u %8u %7u %12llu %12llu %4u.%u\n",
+			snap[i].id,
+			snap[i].status == ENV_RUNNABLE ? "runnable" : "blocked",
+			snap[i].runs, snap[i].syscalls, snap[i].traps,
+			snap[i].pgfaults, snap[i].user / 1000000,
+			snap[i].kern / 1000000, permille / 10, permille % 10);
+	}
+}